@@ -1,6 +1,8 @@
 #ifndef _PRODUCERCONSUMERQUEUE_H_
 #define _PRODUCERCONSUMERQUEUE_H_
 
+// 换成MPMCQueue之前WorkerPool使用的队列, 原样保留, 只作为queue_bench的基线
+
 #include <mutex>
 #include <limits>
 #include <queue>
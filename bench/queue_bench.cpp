@@ -0,0 +1,110 @@
+// WorkerPool入口队列的吞吐对比: 基线ProducerConsumerQueue(互斥锁+条件变量)
+// 和MPMCQueue(无锁环形数组+Parker), 生产者和消费者各1, 2, 8, 32个线程.
+// 用法: queue_bench [每轮消息数, 默认2000000]
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "mpmcQueue.h"
+#include "producerConsumerQueue.h"
+
+namespace {
+
+// 和Context一样带两个shared_ptr, 入队出队时有同样的引用计数开销
+struct Item {
+    std::shared_ptr<int> con;
+    std::shared_ptr<int> msg;
+    int64_t seq = 0;
+};
+
+struct Result {
+    double seconds;
+    // 队列满时生产者重试的次数
+    uint64_t full;
+};
+
+// producers个线程共推入total条消息, consumers个线程取到total条为止
+template <typename Push, typename Get>
+Result run(int producers, int consumers, int64_t total, Push push, Get get) {
+    std::atomic<int64_t> consumed(0);
+    std::atomic<bool> go(false);
+    std::shared_ptr<int> con = std::make_shared<int>(0);
+    std::shared_ptr<int> msg = std::make_shared<int>(0);
+    std::atomic<uint64_t> retries(0);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p] {
+            while (!go.load()) std::this_thread::yield();
+            Item item;
+            item.con = con;
+            item.msg = msg;
+            uint64_t full = 0;
+            for (int64_t i = p; i < total; i += producers) {
+                item.seq = i;
+                while (!push(item)) {
+                    full++;
+                    std::this_thread::yield();
+                }
+            }
+            retries += full;
+        });
+    }
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&] {
+            while (!go.load()) std::this_thread::yield();
+            Item item;
+            while (consumed.load(std::memory_order_relaxed) < total) {
+                if (get(&item))
+                    consumed.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    auto begin = std::chrono::steady_clock::now();
+    go = true;
+    for (auto &t : threads) t.join();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+    return {elapsed.count(), retries.load()};
+}
+
+void report(const char *name, int threads, int64_t total, const Result &r) {
+    std::printf("%-22s %3d x %-3d %10.0f ops/s %8.1f ns/op  full: %llu\n",
+                name, threads, threads, total / r.seconds,
+                r.seconds * 1e9 / total, (unsigned long long)r.full);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int64_t total = argc > 1 ? std::atoll(argv[1]) : 2000000;
+    std::printf("hardware threads: %u, messages per run: %lld\n",
+                std::thread::hardware_concurrency(), (long long)total);
+    for (int n : {1, 2, 8, 32}) {
+        {
+            ProducerConsumerQueue<Item> queue;
+            Result r = run(
+                n, n, total,
+                [&](const Item &item) {
+                    queue.push(item);
+                    return true;
+                },
+                [&](Item *item) { return queue.get(item, 1); });
+            report("ProducerConsumerQueue", n, total, r);
+        }
+        {
+            // 和SHARED模式下每个lane的容量一致
+            MPMCQueue<Item> queue(16384);
+            Result r = run(
+                n, n, total, [&](const Item &item) { return queue.push(item); },
+                [&](Item *item) { return queue.get(item, 1); });
+            report("MPMCQueue", n, total, r);
+        }
+    }
+    return 0;
+}
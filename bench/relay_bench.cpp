@@ -0,0 +1,253 @@
+// 转发一条带6KB SDP offer的SEND_SDP_OFFER的开销:
+// 每条消息的malloc次数、申请的字节数(近似拷贝的字节数)和耗时.
+//   copy+Parse:  原来的做法, 复制payload后Parse, offer取成std::string,
+//                再放进新的Document转义序列化, 最后复制进发出去的消息
+//   ParseInsitu: 在消息自己的缓冲上原地解析, offer以string_view传下去,
+//                重新转义后拼进信令, 直接写在发出去的消息里
+//   relay:       WorkerPool::relay的快速路径, 只扫描路由字段,
+//                把payload里原始的offer文本拼进信令, 不解析也不转义
+// 前两种需要RapidJSON, 没有时只跑relay
+// 用法: relay_bench [消息数, 默认20000]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rawJson.h"
+#ifdef BENCH_WITH_RAPIDJSON
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#endif
+
+// rapidjson的CrtAllocator直接调malloc, 所以在malloc这一层计数
+static bool counting = false;
+static uint64_t allocs = 0;
+static uint64_t alloc_bytes = 0;
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_calloc(size_t count, size_t size);
+
+void *malloc(size_t size) noexcept {
+    if (counting) {
+        allocs++;
+        alloc_bytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+    if (counting) {
+        allocs++;
+        alloc_bytes += size;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+    if (counting) {
+        allocs++;
+        alloc_bytes += count * size;
+    }
+    return __libc_calloc(count, size);
+}
+}
+
+namespace {
+
+#ifdef BENCH_WITH_RAPIDJSON
+// 和util.h中的StringWriteStream一致
+class StringWriteStream {
+public:
+    typedef char Ch;
+    explicit StringWriteStream(std::string *out) : out_(out) {}
+    void Put(char c) { out_->push_back(c); }
+    void Flush() {}
+
+private:
+    std::string *out_;
+};
+#endif
+
+// 按json字符串的规则转义
+std::string quote(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out.push_back('\\');
+        out.push_back(c);
+    }
+    out.push_back('"');
+    return out;
+}
+
+// 和客户端sendSDPOffer一样, offer是JSON.stringify后的字符串,
+// 里面的sdp约6KB, 每行以\r\n结尾, 在payload里是两层转义
+std::string makePayload() {
+    std::string sdp =
+        "v=0\\r\\no=- 4611731400430051336 2 IN IP4 127.0.0.1\\r\\ns=-\\r\\n"
+        "t=0 0\\r\\na=group:BUNDLE 0 1\\r\\na=msid-semantic: WMS stream\\r\\n";
+    int i = 0;
+    while (sdp.size() < 6 * 1024) {
+        sdp += "a=candidate:" + std::to_string(842163049 + i) +
+               " 1 udp 1677729535 203.0.113." + std::to_string(i % 250) +
+               " " + std::to_string(50000 + i) +
+               " typ srflx raddr 0.0.0.0 rport 0 generation 0 "
+               "network-cost 999\\r\\n";
+        sdp += "a=rtpmap:" + std::to_string(96 + i % 32) +
+               " VP8/90000\\r\\na=rtcp-fb:" + std::to_string(96 + i % 32) +
+               " goog-remb\\r\\n";
+        i++;
+    }
+    std::string offer = "{\"type\":\"offer\",\"sdp\":\"" + sdp + "\"}";
+    return "{\"operate\":21,\"from_pid\":4194305,\"dest_pid\":4194306,"
+           "\"rid\":4194307,\"offer\":" +
+           quote(offer) + ",\"req_id\":17}";
+}
+
+// 信令信封, 和Session::makeRawSignal一致
+void appendEnvelope(std::string *out, int64_t from_pid, const char *type,
+                    const char *key, std::string_view raw) {
+    out->append("{\"type\":\"").append(type);
+    out->append("\",\"msg\":\"signaling\",\"from_pid\":")
+        .append(std::to_string(from_pid));
+    out->append(",\"").append(key).append("\":").append(raw).append("}");
+}
+
+#ifdef BENCH_WITH_RAPIDJSON
+// 原来的做法: workerPool复制payload再Parse, getOffer复制出std::string,
+// Session::sendSignal放进新Document序列化, sendMsg再复制进消息
+size_t copyParse(const std::string &message) {
+    std::string payload = message;
+    rapidjson::Document doc;
+    doc.Parse(payload.c_str());
+    int64_t from_pid = doc["from_pid"].GetInt64();
+    std::string offer = doc["offer"].GetString();
+
+    rapidjson::Document d;
+    d.SetObject();
+    d.AddMember("type", rapidjson::Value("SDPOffer", d.GetAllocator()),
+                d.GetAllocator());
+    d.AddMember("msg", "signaling", d.GetAllocator());
+    d.AddMember("from_pid", from_pid, d.GetAllocator());
+    d.AddMember(rapidjson::Value("offer", d.GetAllocator()),
+                rapidjson::Value(offer.c_str(), d.GetAllocator()),
+                d.GetAllocator());
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    d.Accept(writer);
+    std::string text = buffer.GetString();
+    std::string frame(text);
+    return frame.size();
+}
+
+// 完整解析的路径: 在消息的payload上ParseInsitu,
+// getRaw把offer重新转义成json文本, 再拼进直接申请的消息里
+size_t parseInsitu(std::string &payload) {
+    rapidjson::Document doc;
+    doc.ParseInsitu(&payload[0]);
+    int64_t from_pid = doc["from_pid"].GetInt64();
+    std::string storage;
+    StringWriteStream stream(&storage);
+    rapidjson::Writer<StringWriteStream> writer(stream);
+    doc["offer"].Accept(writer);
+    std::string frame;
+    frame.reserve(storage.size() + 96);
+    appendEnvelope(&frame, from_pid, "SDPOffer", "offer", storage);
+    return frame.size();
+}
+#endif
+
+// 快速路径: 预读operate, 扫描路由字段和offer的原始文本, 拼进信令
+size_t relay(std::string &payload) {
+    int64_t opt;
+    if (!peekInt64(payload, "operate", &opt))
+        return 0;
+    enum { FROM_PID, RID, DEST, RAW, REQ_ID };
+    RawField fields[] = {{"from_pid", {}},
+                         {"rid", {}},
+                         {"dest_pid", {}},
+                         {"offer", {}},
+                         {"req_id", {}}};
+    if (!scanFields(payload, fields, sizeof(fields) / sizeof(fields[0])))
+        return 0;
+    int64_t from_pid, rid, dest_pid;
+    if (!rawToInt64(fields[FROM_PID].raw, &from_pid) ||
+        !rawToInt64(fields[RID].raw, &rid) ||
+        !rawToInt64(fields[DEST].raw, &dest_pid))
+        return 0;
+    std::string_view raw = fields[RAW].raw;
+    if (raw.empty() || raw.front() != '"')
+        return 0;
+    std::string frame;
+    frame.reserve(raw.size() + 96);
+    appendEnvelope(&frame, from_pid, "SDPOffer", "offer", raw);
+    return frame.size();
+}
+
+struct Result {
+    double ns;
+    double allocs;
+    double bytes;
+    size_t frame;
+};
+
+// 每轮先准备好kRound份payload(相当于收到的消息), 只统计处理它们的部分
+template <typename Fn>
+Result run(const std::string &payload, int total, Fn fn) {
+    const int kRound = 1000;
+    double seconds = 0;
+    uint64_t n_allocs = 0, n_bytes = 0;
+    size_t frame = 0;
+    std::vector<std::string> messages;
+    for (int done = 0; done < total; done += kRound) {
+        messages.assign(kRound, payload);
+        allocs = alloc_bytes = 0;
+        counting = true;
+        auto begin = std::chrono::steady_clock::now();
+        for (auto &message : messages) {
+            frame = fn(message);
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+        counting = false;
+        seconds += elapsed.count();
+        n_allocs += allocs;
+        n_bytes += alloc_bytes;
+    }
+    int runs = (total + kRound - 1) / kRound * kRound;
+    return {seconds * 1e9 / runs, double(n_allocs) / runs,
+            double(n_bytes) / runs, frame};
+}
+
+void report(const char *name, const Result &r) {
+    std::printf("%-12s %9.0f ns/msg %6.1f allocs/msg %9.0f bytes/msg  "
+                "frame: %zu\n",
+                name, r.ns, r.allocs, r.bytes, r.frame);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int total = argc > 1 ? std::atoi(argv[1]) : 20000;
+    std::string payload = makePayload();
+    std::printf("payload: %zu bytes, messages: %d\n", payload.size(), total);
+#ifdef BENCH_WITH_RAPIDJSON
+    report("copy+Parse", run(payload, total, [](std::string &message) {
+               return copyParse(message);
+           }));
+    report("ParseInsitu", run(payload, total, [](std::string &message) {
+               return parseInsitu(message);
+           }));
+#endif
+    report("relay", run(payload, total, [](std::string &message) {
+               return relay(message);
+           }));
+    return 0;
+}
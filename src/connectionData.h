@@ -0,0 +1,53 @@
+#ifndef _CONNECTIONDATA_H_
+#define _CONNECTIONDATA_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "operate.h"
+#include "tokenBucket.h"
+
+class OutboundQueue;
+
+// 客户端在握手时请求这个子协议, 表示可以接收把多条消息合并成的json数组
+constexpr const char kBatchSubprotocol[] = "signaling.batch";
+
+// 挂在每个websocket连接上的状态(作为websocketpp config的connection_base),
+// 随连接一起分配和释放, 访问时不需要查表也不需要加锁
+struct ConnectionData {
+    ConnectionData() : dropped_(0), batch_(false), pending_(0), lane_(0) {}
+
+    // 整个连接的限流
+    TokenBucket total_;
+    // 每类操作的限流
+    TokenBucket lanes_[LANE_COUNT];
+    // 被限流丢弃的消息数
+    std::atomic<uint32_t> dropped_;
+    // 握手时协商了kBatchSubprotocol
+    std::atomic<bool> batch_;
+    // AFFINITY模式下这个连接已入队但还没处理完的消息数
+    std::atomic<int> pending_;
+    // 这个连接的消息所在的lane, 由所在slot的锁保护.
+    // 不同lane之间按权重出队会打乱顺序, 所以同一个连接的消息在排空之前
+    // 都进同一个lane. 按连接而不是按slot记, 共用slot的其他连接不受影响
+    int lane_;
+
+    // 登录后这个连接上的peer的发送队列, 回复也经过它, 和推送的信令保持顺序.
+    // 只持有weak_ptr, peer释放后自动失效
+    void setOutbound(const std::shared_ptr<OutboundQueue> &out) {
+        std::lock_guard<std::mutex> lock(out_mu_);
+        out_ = out;
+    }
+    std::shared_ptr<OutboundQueue> outbound() {
+        std::lock_guard<std::mutex> lock(out_mu_);
+        return out_.lock();
+    }
+
+private:
+    std::mutex out_mu_;
+    std::weak_ptr<OutboundQueue> out_;
+};
+
+#endif  // _CONNECTIONDATA_H_
@@ -1,28 +1,59 @@
 #ifndef _CONTEXT_H_
 #define _CONTEXT_H_
 
+#include <chrono>
+
 #include "type.h"
 
 class Context
 {
 public:
-    Context() {}
+    Context()
+        : slot_(-1),
+          lane_(0),
+          bytes_(0),
+          batch_(false) {}
 
     Context(Type::connection_ptr con, Type::message_ptr msg)
-        : con_(con), msg_(msg) {}
+        : con_(con),
+          msg_(msg),
+          slot_(-1),
+          lane_(0),
+          bytes_(0),
+          batch_(false) {}
     
     Context(const Context &other) {
         con_ = other.con_;
         msg_ = other.msg_;
+        slot_ = other.slot_;
+        lane_ = other.lane_;
+        enqueue_time_ = other.enqueue_time_;
+        bytes_ = other.bytes_;
+        batch_ = other.batch_;
     }
 
     void operator=(const Context &other) {
         con_ = other.con_;
         msg_ = other.msg_;
+        slot_ = other.slot_;
+        lane_ = other.lane_;
+        enqueue_time_ = other.enqueue_time_;
+        bytes_ = other.bytes_;
+        batch_ = other.batch_;
     }
 
     Type::connection_ptr con_;
     Type::message_ptr msg_;
+    // WorkerPool的路由槽, -1表示未路由
+    int slot_;
+    // 调度优先级, 见operate.h中的LANE
+    int lane_;
+    // 入队时间, 用于统计排队延迟
+    std::chrono::steady_clock::time_point enqueue_time_;
+    // 入队时payload的大小, 用于统计排队字节数
+    size_t bytes_;
+    // payload是操作数组(批量请求)
+    bool batch_;
 };
 
 #endif // _CONTEXT_H_
\ No newline at end of file
@@ -0,0 +1,117 @@
+#ifndef _DISPATCHQUEUE_H_
+#define _DISPATCHQUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "mpmcQueue.h"
+
+// 按优先级分成多条lane的调度队列, 每条lane是一个MPMCQueue.
+// 出队按权重加权轮询: weights = {8, 4, 2, 1}时, 每15次出队里lane 0占8次,
+// 被选中的lane为空时按优先级从高到低取, 低优先级lane也不会饿死.
+template <typename Type>
+class DispatchQueue {
+public:
+    DispatchQueue(size_t lane_capacity, const std::vector<int> &weights)
+        : tick_(0) {
+        for (size_t i = 0; i < weights.size(); i++) {
+            lanes_.emplace_back(new MPMCQueue<Type>(lane_capacity));
+        }
+        buildWheel(weights);
+    }
+    DispatchQueue(const DispatchQueue &) = delete;
+    DispatchQueue &operator=(const DispatchQueue &) = delete;
+
+    void stop() {
+        for (auto &lane : lanes_) {
+            lane->stop();
+        }
+        parker_.stop();
+    }
+
+    // not block, lane满时返回false
+    bool push(const Type &value, int lane) {
+        if (!lanes_[lane]->push(value))
+            return false;
+        parker_.notify();
+        return true;
+    }
+
+    // not block, 按权重选择lane
+    bool tryGet(Type *item) {
+        size_t tick = tick_.fetch_add(1, std::memory_order_relaxed);
+        if (lanes_[wheel_[tick % wheel_.size()]]->tryGet(item))
+            return true;
+        for (auto &lane : lanes_) {
+            if (lane->tryGet(item))
+                return true;
+        }
+        return false;
+    }
+
+    bool get(Type *item, const int64_t timeout_ms = 0) {
+        return parker_.wait([this, item] { return this->tryGet(item); },
+                            timeout_ms);
+    }
+
+    // 阻塞等到第一个元素, 再不阻塞地最多取到max个, 追加到out, 返回取到的数量
+    size_t getBatch(std::vector<Type> *out, size_t max,
+                    const int64_t timeout_ms = 0) {
+        Type item;
+        if (max == 0 || !get(&item, timeout_ms))
+            return 0;
+        size_t n = 1;
+        out->push_back(std::move(item));
+        while (n < max && tryGet(&item)) {
+            out->push_back(std::move(item));
+            n++;
+        }
+        return n;
+    }
+
+    int laneCount() const { return lanes_.size(); }
+
+    size_t capacity(int lane) const { return lanes_[lane]->capacity(); }
+
+    // 近似值, 仅用于统计
+    size_t size(int lane) const { return lanes_[lane]->size(); }
+
+    size_t size() const {
+        size_t n = 0;
+        for (auto &lane : lanes_) {
+            n += lane->size();
+        }
+        return n;
+    }
+
+    uint64_t overflow(int lane) const { return lanes_[lane]->overflow(); }
+
+private:
+    // 平滑加权轮询生成出队序列, 避免同一lane连续占满
+    void buildWheel(const std::vector<int> &weights) {
+        int total = 0;
+        for (int w : weights) {
+            total += w < 1 ? 1 : w;
+        }
+        std::vector<int> current(weights.size(), 0);
+        for (int i = 0; i < total; i++) {
+            int best = 0;
+            for (size_t j = 0; j < weights.size(); j++) {
+                current[j] += weights[j] < 1 ? 1 : weights[j];
+                if (current[j] > current[best])
+                    best = j;
+            }
+            current[best] -= total;
+            wheel_.push_back(best);
+        }
+    }
+
+    std::vector<std::unique_ptr<MPMCQueue<Type>>> lanes_;
+    std::vector<int> wheel_;
+    alignas(MPMCQueue<Type>::kCacheLine) std::atomic<size_t> tick_;
+    Parker parker_;
+};
+
+#endif  // _DISPATCHQUEUE_H_
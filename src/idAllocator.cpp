@@ -0,0 +1,53 @@
+#include "idAllocator.h"
+
+IdAllocator::IdAllocator() {}
+
+int64_t IdAllocator::allocate() {
+    std::lock_guard<std::mutex> lock(mu_);
+    while (!free_.empty()) {
+        uint32_t index = free_.back();
+        free_.pop_back();
+        Slot &slot = slots_[index];
+        slot.queued = false;
+        if (slot.used)
+            continue;
+        slot.used = true;
+        slot.generation = (slot.generation + 1) & kMaxGeneration;
+        return int64_t(slot.generation) << kIndexBits | index;
+    }
+    if (int64_t(slots_.size()) > kMaxIndex)
+        return -1;
+    slots_.push_back(Slot{0, true, false});
+    return int64_t(slots_.size() - 1);
+}
+
+bool IdAllocator::claim(int64_t id) {
+    if (id < 0 || (id >> kIndexBits) > kMaxGeneration)
+        return false;
+    std::lock_guard<std::mutex> lock(mu_);
+    int64_t index = indexOf(id);
+    if (index >= int64_t(slots_.size()))
+        return false;
+    Slot &slot = slots_[index];
+    if (slot.used || slot.generation != generationOf(id))
+        return false;
+    slot.used = true;
+    return true;
+}
+
+void IdAllocator::release(int64_t id) {
+    if (id < 0)
+        return;
+    std::lock_guard<std::mutex> lock(mu_);
+    int64_t index = indexOf(id);
+    if (index >= int64_t(slots_.size()))
+        return;
+    Slot &slot = slots_[index];
+    if (!slot.used || slot.generation != generationOf(id))
+        return;
+    slot.used = false;
+    if (!slot.queued) {
+        slot.queued = true;
+        free_.push_back(static_cast<uint32_t>(index));
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef _IDALLOCATOR_H_
+#define _IDALLOCATOR_H_
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// pid/rid分配器. id = generation << kIndexBits | index:
+// 释放的index进空闲栈, 再分配时generation加1, 同一个index上前后两个
+// 使用者的id不同, 发给旧id的消息不会落到新的使用者身上.
+// 分配和释放都是O(1). id不超过2^53, js客户端可以精确表示
+class IdAllocator {
+public:
+    static const int kIndexBits = 22;
+    static const int kGenerationBits = 31;
+    static const int64_t kMaxIndex = (int64_t(1) << kIndexBits) - 1;
+    static const int64_t kMaxGeneration = (int64_t(1) << kGenerationBits) - 1;
+
+    IdAllocator();
+    IdAllocator(const IdAllocator &) = delete;
+    IdAllocator &operator=(const IdAllocator &) = delete;
+
+    // 没有可用的index时返回-1
+    int64_t allocate();
+    // 重连的客户端想要回自己原来的id: 只有这个id是该index最后发出的,
+    // 并且已经释放、没有被重新分配时才成功
+    bool claim(int64_t id);
+    void release(int64_t id);
+
+private:
+    struct Slot {
+        uint32_t generation;
+        bool used;
+        // index在free_中, 反复claim/release同一个id时不会重复入栈
+        bool queued;
+    };
+
+    static int64_t indexOf(int64_t id) { return id & kMaxIndex; }
+    static uint32_t generationOf(int64_t id) {
+        return static_cast<uint32_t>(id >> kIndexBits);
+    }
+
+    std::mutex mu_;
+    std::vector<Slot> slots_;
+    // 被claim拿走的index不会从栈里删除, 出栈时跳过正在使用的
+    std::vector<uint32_t> free_;
+};
+
+#endif  // _IDALLOCATOR_H_
@@ -15,7 +15,9 @@ int main()
     try
     {
         log4cxx::PropertyConfigurator::configure("../conf/log.conf");
-        sigServer server;
+        int cores = std::thread::hardware_concurrency();
+        // 每个核一个shard, SO_REUSEPORT分摊建连
+        sigServer server(cores, cores);
         server.run(9000);
     }
     catch (std::exception const &e)
@@ -0,0 +1,207 @@
+#ifndef _MPMCQUEUE_H_
+#define _MPMCQUEUE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 消费者先自旋一段时间再挂到条件变量上; 生产者只有在有消费者挂起时才加锁通知
+class Parker {
+public:
+    Parker() : waiters_(0), stop_(false) {}
+    Parker(const Parker &) = delete;
+    Parker &operator=(const Parker &) = delete;
+
+    // 生产者放入数据后调用
+    void notify() {
+        // 与wait中的waiters_++配对, 保证不会丢失唤醒
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(mu_);
+            cv_.notify_one();
+        }
+    }
+
+    // 等到tryGet()返回true或超时/stop, 返回tryGet()是否成功
+    template <typename TryGet>
+    bool wait(TryGet tryGet, const int64_t timeout_ms) {
+        for (int i = 0; i < kSpinCount; i++) {
+            if (tryGet())
+                return true;
+            if (i >= kBusySpinCount)
+                std::this_thread::yield();
+        }
+        if (timeout_ms <= 0 || stop_.load())
+            return false;
+
+        waiters_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool got = false;
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                         [this, &tryGet, &got] {
+                             return (got = tryGet()) || stop_.load();
+                         });
+        }
+        waiters_.fetch_sub(1);
+        return got;
+    }
+
+    // 唤醒所有等待的消费者
+    void stop() {
+        stop_.store(true);
+        std::lock_guard<std::mutex> lock(mu_);
+        cv_.notify_all();
+    }
+
+private:
+    static const int kBusySpinCount = 64;
+    static const int kSpinCount = 256;
+
+    std::atomic<int> waiters_;
+    std::atomic<bool> stop_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+};
+
+// 有界无锁多生产者多消费者队列(Dmitry Vyukov的环形数组算法)
+// 每个槽位带一个序号, 生产者/消费者各自CAS推进位置, 不需要互斥锁;
+// 队列满时push直接失败并计入overflow, 不会无限增长.
+// 空闲的消费者通过Parker先自旋一段时间, 之后才挂起.
+template <typename Type>
+class MPMCQueue {
+public:
+    static const size_t kCacheLine = 64;
+
+    // capacity会向上取整到2的幂
+    explicit MPMCQueue(size_t capacity = 65536)
+        : capacity_(roundUp(capacity)),
+          mask_(capacity_ - 1),
+          cells_(new Cell[capacity_]),
+          enqueue_pos_(0),
+          dequeue_pos_(0),
+          overflow_(0) {
+        for (size_t i = 0; i < capacity_; i++) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    MPMCQueue(const MPMCQueue &) = delete;
+    MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+    // 唤醒所有等待的消费者
+    void stop() { parker_.stop(); }
+
+    // not block, 队列满时返回false
+    bool push(const Type &value) {
+        Cell *cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                overflow_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = value;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        parker_.notify();
+        return true;
+    }
+
+    // not block
+    bool tryGet(Type *item) {
+        Cell *cell;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        *item = std::move(cell->data);
+        cell->data = Type();
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 先自旋, 再挂起, 最多等待timeout_ms
+    bool get(Type *item, const int64_t timeout_ms = 0) {
+        return parker_.wait([this, item] { return this->tryGet(item); },
+                            timeout_ms);
+    }
+
+    // 阻塞等到第一个元素, 再不阻塞地最多取到max个, 追加到out, 返回取到的数量
+    size_t getBatch(std::vector<Type> *out, size_t max,
+                    const int64_t timeout_ms = 0) {
+        Type item;
+        if (max == 0 || !get(&item, timeout_ms))
+            return 0;
+        size_t n = 1;
+        out->push_back(std::move(item));
+        while (n < max && tryGet(&item)) {
+            out->push_back(std::move(item));
+            n++;
+        }
+        return n;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // 近似值, 仅用于统计
+    size_t size() const {
+        size_t enq = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t deq = dequeue_pos_.load(std::memory_order_relaxed);
+        return enq > deq ? enq - deq : 0;
+    }
+
+    // 因队列满被拒绝的push次数
+    uint64_t overflow() const {
+        return overflow_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct alignas(kCacheLine) Cell {
+        std::atomic<size_t> seq;
+        Type data;
+    };
+
+    static size_t roundUp(size_t n) {
+        size_t r = 2;
+        while (r < n) r <<= 1;
+        return r;
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    // 生产者和消费者的位置放在不同的cache line, 避免伪共享
+    alignas(kCacheLine) std::atomic<size_t> enqueue_pos_;
+    alignas(kCacheLine) std::atomic<size_t> dequeue_pos_;
+    alignas(kCacheLine) std::atomic<uint64_t> overflow_;
+    Parker parker_;
+};
+
+#endif  // _MPMCQUEUE_H_
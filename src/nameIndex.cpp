@@ -0,0 +1,49 @@
+#include "nameIndex.h"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+void NameIndex::add(const std::string &name, int64_t pid) {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    if (!sorted_.emplace(name, pid).second)
+        return;
+    exact_[name].push_back(pid);
+}
+
+void NameIndex::remove(const std::string &name, int64_t pid) {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+    if (sorted_.erase(Entry(name, pid)) == 0)
+        return;
+    auto e = exact_.find(name);
+    if (e == exact_.end())
+        return;
+    std::vector<int64_t> &pids = e->second;
+    pids.erase(std::find(pids.begin(), pids.end(), pid));
+    if (pids.empty())
+        exact_.erase(e);
+}
+
+std::vector<int64_t> NameIndex::find(std::string_view name) const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    auto e = exact_.find(std::string(name));
+    if (e == exact_.end())
+        return {};
+    return e->second;
+}
+
+bool NameIndex::prefix(std::string_view prefix, const Entry *after,
+                       size_t limit, std::vector<Entry> *out) const {
+    Entry first(std::string(prefix), std::numeric_limits<int64_t>::min());
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    auto it = after && first < *after ? sorted_.upper_bound(*after)
+                                      : sorted_.lower_bound(first);
+    for (; it != sorted_.end(); ++it) {
+        if (it->first.compare(0, prefix.size(), prefix) != 0)
+            return false;
+        if (out->size() == limit)
+            return true;
+        out->push_back(*it);
+    }
+    return false;
+}
@@ -0,0 +1,37 @@
+#ifndef _NAMEINDEX_H_
+#define _NAMEINDEX_H_
+
+#include <cstdint>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 在线peer的名字索引, 登录/登出时维护.
+// 精确查找走哈希表O(1), 前缀查找在按(name, pid)排好序的集合上
+// lower_bound后顺序取, 与在线人数无关, 只和limit有关
+class NameIndex {
+public:
+    typedef std::pair<std::string, int64_t> Entry;
+
+    void add(const std::string &name, int64_t pid);
+    void remove(const std::string &name, int64_t pid);
+
+    // 同名的所有pid, 按登录先后
+    std::vector<int64_t> find(std::string_view name) const;
+    // 按(name, pid)顺序从after之后(after为空时从头)最多取limit个匹配,
+    // 后面还有时返回true. 翻页时把上一页最后一个作为after
+    bool prefix(std::string_view prefix, const Entry *after, size_t limit,
+                std::vector<Entry> *out) const;
+
+private:
+    // 读多写少, 搜索之间互不阻塞
+    mutable std::shared_mutex mu_;
+    std::unordered_map<std::string, std::vector<int64_t>> exact_;
+    std::set<Entry> sorted_;
+};
+
+#endif  // _NAMEINDEX_H_
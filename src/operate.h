@@ -33,7 +33,74 @@ enum OPERATE {
     CLOSE_SCREEN,
     OPEN_AUDIO,
     CLOSE_AUDIO,
+    // 一次发给多个会话成员, dest_pids缺省时发给除自己外的所有成员
+    MULTICAST_SDP_OFFER,
+    MULTICAST_ICE_CANDIDATE,
+    // 组合操作, 一次请求完成入会前的几步, 回复里带pid、房间成员和会话状态
+    LOG_IN_JOIN_ROOM,
+    JOIN_ROOM_SESSION,
+    LOG_IN_JOIN_SESSION,
     Unkown,
 };
 
+// 调度优先级, 数值越小优先级越高
+enum LANE {
+    // 会话协商, 直接影响通话建立时间
+    NEGOTIATION = 0,
+    // 登录、房间和会话的成员/状态变化
+    SESSION_CONTROL,
+    // 文本消息
+    MESSAGING,
+    // 目录查询
+    QUERY,
+    LANE_COUNT,
+};
+
+inline int laneOf(int opt) {
+    switch (opt) {
+        case SEND_SDP_OFFER:
+        case SEND_SDP_ANSWER:
+        case SEND_ICE_CANDIDATE:
+        case MULTICAST_SDP_OFFER:
+        case MULTICAST_ICE_CANDIDATE:
+        case CONNECTED:
+            return NEGOTIATION;
+        case SEND_TO:
+        case SEND_TO_ROOM:
+        case SEND_TO_SESSION:
+            return MESSAGING;
+        case SEARCH_PEER:
+        case SEARCH_ROOM:
+        case GET_PEERS_IN_ROOM:
+        case GET_ALL_PEERS:
+        case GET_SESSION_STATUS:
+            return QUERY;
+        case LOG_IN:
+        case LOG_OUT:
+        case CREATE_ROOM:
+        case JOIN_ROOM:
+        case LEFT_ROOM:
+        case CALL:
+        case CALL_ACCEPT:
+        case CALL_REJECT:
+        case INVITE:
+        case INVITE_ACCEPT:
+        case INVITE_REJECT:
+        case JOIN_SESSION:
+        case LEFT_SESSION:
+        case LOG_IN_JOIN_ROOM:
+        case JOIN_ROOM_SESSION:
+        case LOG_IN_JOIN_SESSION:
+        case OPEN_CAMERA:
+        case CLOSE_CAMERA:
+        case OPEN_SCREEN:
+        case CLOSE_SCREEN:
+        case OPEN_AUDIO:
+        case CLOSE_AUDIO:
+            return SESSION_CONTROL;
+        default:
+            return QUERY;
+    }
+}
+
 #endif  // _OPERATE_H_
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "outboundQueue.h"
+
+log4cxx::LoggerPtr OutboundQueue::logger_ =
+    log4cxx::Logger::getLogger("processor");
+
+OutboundQueue::Config OutboundQueue::config_ = {
+    1 << 20,  // budget_bytes
+    64 << 10,  // window_bytes
+    OutboundQueue::Policy::COALESCE,
+    20,  // retry_ms
+    5,  // batch_ms
+    16 << 10,  // batch_bytes
+};
+std::atomic<uint64_t> OutboundQueue::dropped_(0);
+std::atomic<uint64_t> OutboundQueue::coalesced_(0);
+std::atomic<uint64_t> OutboundQueue::disconnected_(0);
+std::atomic<uint64_t> OutboundQueue::queued_bytes_(0);
+std::atomic<uint64_t> OutboundQueue::batch_frames_(0);
+std::atomic<uint64_t> OutboundQueue::batch_messages_(0);
+
+void OutboundQueue::setConfig(const Config &config) { config_ = config; }
+
+OutboundQueue::Stats OutboundQueue::stats() {
+    return {dropped_.load(),      coalesced_.load(),
+            disconnected_.load(), queued_bytes_.load(),
+            batch_frames_.load(), batch_messages_.load()};
+}
+
+OutboundQueue::OutboundQueue(const Type::connection_ptr &con, int64_t pid)
+    : con_(con),
+      pid_(pid),
+      bytes_(0),
+      timer_pending_(false),
+      closed_(false),
+      batching_(con->batch_.load()),
+      batch_bytes_(0),
+      flush_pending_(false) {}
+
+bool OutboundQueue::push(Type::message_ptr msg, Priority priority,
+                         const std::string &key) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (closed_)
+        return false;
+    // 没有积压并且websocketpp的缓冲还在窗口内时直接发送
+    if (bytes_ == 0 && con_->get_buffered_amount() < config_.window_bytes)
+        return emit(msg);
+
+    size_t size = msg->get_payload().size();
+    if (!makeRoom(size, priority, key)) {
+        if (priority == CHAT) {
+            dropped_++;
+            return true;
+        }
+        disconnect();
+        return false;
+    }
+    queues_[priority].push_back({std::move(msg), key});
+    bytes_ += size;
+    queued_bytes_ += size;
+    drain();
+    return !closed_;
+}
+
+bool OutboundQueue::makeRoom(size_t size, Priority priority,
+                             const std::string &key) {
+    if (config_.policy == Policy::COALESCE && priority == STATE &&
+        !key.empty()) {
+        auto &queue = queues_[STATE];
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->key == key) {
+                it = pop(queue, it);
+                coalesced_++;
+            } else {
+                ++it;
+            }
+        }
+    }
+    if (bytes_ + size <= config_.budget_bytes)
+        return true;
+    if (config_.policy == Policy::DISCONNECT)
+        return false;
+    auto &chat = queues_[CHAT];
+    while (!chat.empty() && bytes_ + size > config_.budget_bytes) {
+        pop(chat, chat.begin());
+        dropped_++;
+    }
+    return bytes_ + size <= config_.budget_bytes;
+}
+
+std::deque<OutboundQueue::Item>::iterator OutboundQueue::pop(
+    std::deque<Item> &queue, std::deque<Item>::iterator it) {
+    size_t size = it->msg->get_payload().size();
+    bytes_ -= size;
+    queued_bytes_ -= size;
+    return queue.erase(it);
+}
+
+// 按优先级发送, websocketpp的缓冲超过窗口时停下等timer
+void OutboundQueue::drain() {
+    for (auto &queue : queues_) {
+        while (!queue.empty()) {
+            if (closed_)
+                return;
+            if (con_->get_buffered_amount() >= config_.window_bytes) {
+                startTimer(config_.retry_ms, &timer_pending_,
+                           &OutboundQueue::drain);
+                return;
+            }
+            Type::message_ptr msg = queue.front().msg;
+            pop(queue, queue.begin());
+            emit(msg);
+        }
+    }
+}
+
+void OutboundQueue::startTimer(long ms, bool *pending,
+                               void (OutboundQueue::*fn)()) {
+    if (*pending)
+        return;
+    *pending = true;
+    std::weak_ptr<OutboundQueue> self = shared_from_this();
+    try {
+        con_->set_timer(ms, [self, pending, fn](const Type::error_code &ec) {
+            std::shared_ptr<OutboundQueue> queue = self.lock();
+            if (!queue)
+                return;
+            std::lock_guard<std::mutex> lock(queue->mu_);
+            *pending = false;
+            // 连接关闭时timer会被取消
+            if (ec || queue->closed_)
+                return;
+            ((*queue).*fn)();
+        });
+    } catch (const std::exception &e) {
+        *pending = false;
+        LOG4CXX_WARN(logger_, "failed to set timer for " << pid_ << ": "
+                                                         << e.what());
+    }
+}
+
+bool OutboundQueue::emit(const Type::message_ptr &msg) {
+    if (!batching_)
+        return send(msg);
+    // 空闲时的第一条直接发送, 单条消息不多等batch_ms;
+    // 之后batch_ms内到来的消息才攒起来, 到时合并发送
+    if (batch_.empty() && !flush_pending_) {
+        startTimer(config_.batch_ms, &flush_pending_, &OutboundQueue::flush);
+        return send(msg);
+    }
+    batch_.push_back(msg);
+    batch_bytes_ += msg->get_payload().size();
+    if (batch_bytes_ >= config_.batch_bytes)
+        flush();
+    else
+        startTimer(config_.batch_ms, &flush_pending_, &OutboundQueue::flush);
+    return true;
+}
+
+// 把攒下的消息拼成一个json数组帧, 只有一条时原样发送
+void OutboundQueue::flush() {
+    if (batch_.empty())
+        return;
+    if (batch_.size() == 1) {
+        send(batch_.front());
+    } else {
+        Type::message_ptr frame = con_->get_message(
+            Type::opcode::TEXT, batch_bytes_ + batch_.size() + 1);
+        std::string &out = frame->get_payload();
+        out.push_back('[');
+        for (size_t i = 0; i < batch_.size(); i++) {
+            if (i > 0)
+                out.push_back(',');
+            out.append(batch_[i]->get_payload());
+        }
+        out.push_back(']');
+        batch_frames_++;
+        batch_messages_ += batch_.size();
+        send(frame);
+    }
+    batch_.clear();
+    batch_bytes_ = 0;
+}
+
+bool OutboundQueue::send(const Type::message_ptr &msg) {
+    Type::error_code res_code = con_->send(msg);
+    if (res_code) {
+        LOG4CXX_WARN(logger_, "failed to send msg to "
+                                  << pid_ << ", code: " << res_code.value());
+        return false;
+    }
+    return true;
+}
+
+void OutboundQueue::disconnect() {
+    LOG4CXX_WARN(logger_, "outbound queue of " << pid_ << " exceeds "
+                                               << config_.budget_bytes
+                                               << " bytes, disconnect");
+    closed_ = true;
+    disconnected_++;
+    for (auto &queue : queues_) {
+        while (!queue.empty()) pop(queue, queue.begin());
+    }
+    batch_.clear();
+    batch_bytes_ = 0;
+    Type::error_code ec;
+    con_->close(websocketpp::close::status::policy_violation,
+                "outbound queue overflow", ec);
+}
@@ -0,0 +1,125 @@
+#ifndef _OUTBOUNDQUEUE_H_
+#define _OUTBOUNDQUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "log4cxx/logger.h"
+#include "type.h"
+
+// 每个peer的发送队列.
+// websocketpp自己的发送缓冲没有上限, 网络差的客户端会在服务端堆积大量消息.
+// 这里只在websocketpp缓冲低于window_bytes时才把消息交给它, 其余的按优先级
+// 排在本队列里, 总字节数不超过budget_bytes, 超出时按policy处理.
+// 有积压时用连接上的timer定期重试发送.
+// 握手时协商了kBatchSubprotocol的连接, 空闲时的第一条消息直接发送,
+// 其后batch_ms内的消息合成一个json数组帧发送, 减少帧数和写调用
+class OutboundQueue : public std::enable_shared_from_this<OutboundQueue> {
+public:
+    // 数值越小越先发送
+    enum Priority {
+        // 呼叫/邀请/SDP/ICE, 从不丢弃
+        SIGNALING = 0,
+        // 会话内的状态变化(开关摄像头等), 同一个key只需要最新的一条
+        STATE,
+        // 文本消息
+        CHAT,
+        PRIORITY_COUNT,
+    };
+
+    // 超出预算时的处理, 逐级放宽
+    enum class Policy {
+        // 直接断开连接
+        DISCONNECT,
+        // 丢弃最早的文本消息, 仍然放不下时断开
+        DROP_CHAT,
+        // 先合并同key的状态消息, 再丢弃最早的文本消息, 仍然放不下时断开.
+        // 没有积压时消息直接交给websocketpp, 所以合并只在已有积压时生效
+        COALESCE,
+    };
+
+    struct Config {
+        size_t budget_bytes;
+        size_t window_bytes;
+        Policy policy;
+        long retry_ms;
+        // 合并发送的等待时间和单帧的字节上限
+        long batch_ms;
+        size_t batch_bytes;
+    };
+
+    // 所有peer的累计值
+    struct Stats {
+        uint64_t dropped;
+        uint64_t coalesced;
+        uint64_t disconnected;
+        uint64_t queued_bytes;
+        // 合并发送的帧数和其中的消息数
+        uint64_t batch_frames;
+        uint64_t batch_messages;
+    };
+
+    // 需要在server开始run之前设置
+    static void setConfig(const Config &config);
+    static const Config &config() { return config_; }
+    static Stats stats();
+
+    OutboundQueue(const Type::connection_ptr &con, int64_t pid);
+    OutboundQueue(const OutboundQueue &) = delete;
+    OutboundQueue &operator=(const OutboundQueue &) = delete;
+
+    // msg交给队列之后不能再修改; key非空的STATE消息可以被同key的新消息替换.
+    // 连接已断开或者因为超出预算被断开时返回false
+    bool push(Type::message_ptr msg, Priority priority,
+              const std::string &key = "");
+    int64_t pid() const { return pid_; }
+
+private:
+    struct Item {
+        Type::message_ptr msg;
+        std::string key;
+    };
+
+    // 以下都需要持有mu_
+    bool makeRoom(size_t size, Priority priority, const std::string &key);
+    void drain();
+    void flush();
+    // 在连接上设置timer, 到时持有mu_调用fn; *pending防止重复设置
+    void startTimer(long ms, bool *pending, void (OutboundQueue::*fn)());
+    // 需要合并时放进batch_, 否则直接交给websocketpp
+    bool emit(const Type::message_ptr &msg);
+    bool send(const Type::message_ptr &msg);
+    // 关闭连接, peer的清理由sigServer::on_close完成, 不在mu_下进行
+    void disconnect();
+    // 移除一条并更新计数, 返回下一条
+    std::deque<Item>::iterator pop(std::deque<Item> &queue,
+                                   std::deque<Item>::iterator it);
+
+    static Config config_;
+    static std::atomic<uint64_t> dropped_;
+    static std::atomic<uint64_t> coalesced_;
+    static std::atomic<uint64_t> disconnected_;
+    static std::atomic<uint64_t> queued_bytes_;
+    static std::atomic<uint64_t> batch_frames_;
+    static std::atomic<uint64_t> batch_messages_;
+    static log4cxx::LoggerPtr logger_;
+
+    std::mutex mu_;
+    Type::connection_ptr con_;
+    int64_t pid_;
+    std::deque<Item> queues_[PRIORITY_COUNT];
+    size_t bytes_;
+    bool timer_pending_;
+    bool closed_;
+    bool batching_;
+    std::vector<Type::message_ptr> batch_;
+    size_t batch_bytes_;
+    bool flush_pending_;
+};
+
+#endif  // _OUTBOUNDQUEUE_H_
@@ -1,12 +1,18 @@
 #include "peer.h"
 
+#include "util.h"
+
 log4cxx::LoggerPtr Peer::logger_ = log4cxx::Logger::getLogger("processor");
 
 Peer::Peer(const int64_t &id, const Type::connection_ptr &con,
            const std::string &name)
-    : id_(id), con_(con), name_(name) {
+    : id_(id),
+      con_(con),
+      name_(name),
+      out_(std::make_shared<OutboundQueue>(con, id)) {
     // maybe throw exception, should catch
     ip_ = con_->get_remote_endpoint();
+    con_->setOutbound(out_);
 }
 
 Peer::Peer(const Peer &other) {
@@ -14,6 +20,7 @@ Peer::Peer(const Peer &other) {
     con_ = other.con_;
     ip_ = other.ip_;
     name_ = other.name_;
+    out_ = other.out_;
 }
 
 Peer &Peer::operator=(const Peer &other) {
@@ -21,6 +28,7 @@ Peer &Peer::operator=(const Peer &other) {
     ip_ = other.ip_;
     con_ = other.con_;
     name_ = other.name_;
+    out_ = other.out_;
     return *this;
 }
 
@@ -28,6 +36,7 @@ Peer &Peer::operator=(const Peer &other) {
 Peer::Peer(Peer &&other) : con_(other.con_), id_(other.id_) {
     ip_.swap(other.ip_);
     name_.swap(other.name_);
+    out_.swap(other.out_);
     other.con_.reset();
 }
 
@@ -35,22 +44,19 @@ Peer::~Peer() {}
 
 Type::connection_ptr Peer::getCon() { return con_; }
 
-bool Peer::sendMsg(Type::message_ptr msg) {
-    Type::error_code res_code = con_->send(msg);
-    if (res_code) {
-        LOG4CXX_WARN(logger_, "failed to send msg to "
-                                  << id_ << ", code: " << res_code.value());
-        return false;
-    }
-    return true;
+bool Peer::sendMsg(Type::message_ptr msg, OutboundQueue::Priority priority,
+                   const std::string &key) {
+    return out_->push(std::move(msg), priority, key);
+}
+
+bool Peer::sendMsg(const rapidjson::Document &doc,
+                   OutboundQueue::Priority priority, size_t reserve) {
+    return sendMsg(makeMessage(con_, doc, reserve), priority);
 }
 
-bool Peer::sendMsg(const std::string &msg) {
-    Type::error_code res_code = con_->send(msg, Type::opcode::TEXT);
-    if (res_code) {
-        LOG4CXX_WARN(logger_, "failed to send msg to "
-                                  << id_ << ", code: " << res_code.value());
-        return false;
-    }
-    return true;
-}
\ No newline at end of file
+bool Peer::sendMsg(const std::string &msg, OutboundQueue::Priority priority) {
+    Type::message_ptr message =
+        con_->get_message(Type::opcode::TEXT, msg.size());
+    message->get_payload().assign(msg);
+    return sendMsg(message, priority);
+}
@@ -9,6 +9,8 @@
 
 #include "log4cxx/log4cxx.h"
 #include "log4cxx/logger.h"
+#include "outboundQueue.h"
+#include "rapidjson/document.h"
 #include "type.h"
 #include "peerStatus.h"
 
@@ -23,8 +25,14 @@ public:
     Peer(Peer&& other);
 
     Type::connection_ptr getCon();
-    bool sendMsg(Type::message_ptr msg);
-    bool sendMsg(const std::string& msg);
+    // 都经过发送队列, 按priority排队; key见OutboundQueue::push.
+    // msg可能被多个连接共用, 交给sendMsg之后不能再修改
+    bool sendMsg(Type::message_ptr msg, OutboundQueue::Priority priority,
+                 const std::string& key = "");
+    bool sendMsg(const std::string& msg, OutboundQueue::Priority priority);
+    // 直接序列化到发给这个连接的消息里, reserve为预估的长度
+    bool sendMsg(const rapidjson::Document& doc,
+                 OutboundQueue::Priority priority, size_t reserve = 256);
     ~Peer();
     std::string name() const { return name_; }
     std::string ip() const { return ip_; }
@@ -37,6 +45,8 @@ private:
     std::string name_;
     std::string ip_;
     Type::connection_ptr con_;
+    // 拷贝出来的Peer共用同一个连接的发送队列
+    std::shared_ptr<OutboundQueue> out_;
     static log4cxx::LoggerPtr logger_;
 };
 
@@ -1,5 +1,7 @@
 #include "peerManager.h"
 
+#include <algorithm>
+
 #include "operate.h"
 #include "util.h"
 
@@ -11,66 +13,76 @@ PeerManager* PeerManager::getInstance() {
     return &peer_manager;
 }
 
-PeerManager::PeerManager() : next_id_(0) {}
+PeerManager::PeerManager() {}
 
 PeerManager::~PeerManager() {}
 
-void PeerManager::logIn(Type::connection_ptr con, const std::string& name) {
-    LOG4CXX_INFO(logger_, "name: " << name << " which from "
-                                   << con->get_remote_endpoint()
-                                   << " want to login system");
-    int64_t pid;
-    {
-        std::lock_guard<std::mutex> lock(mu_);
-        while (peers_.find(next_id_) != peers_.end()) next_id_++;
-        pid = next_id_++;
-        if (peers_.find(pid) != peers_.end()) {
-            LOG4CXX_WARN(logger_, "pid:" << pid << " already log in!");
-            response(con, "you have already log in system!");
-            return;
-        }
-        peers_.emplace(pid, std::make_shared<Peer>(pid, con, name));
-    }
-    LOG4CXX_INFO(logger_, "pid:" << pid << " success log in.");
-    response(con, "success", {"pid", std::to_string(pid), "type", "logIn"});
+void PeerManager::logIn(Type::connection_ptr con, std::string_view name) {
+    logIn(con, -1, name);
 }
 
 void PeerManager::logIn(Type::connection_ptr con, int64_t from_pid,
-                        const std::string& name) {
+                        std::string_view name) {
+    std::shared_ptr<Peer> peer = addPeer(con, from_pid, name);
+    if (!peer) {
+        response(con, "server full, try again later");
+        return;
+    }
+    response(con, "success",
+             {"pid", std::to_string(peer->id()), "type", "logIn"});
+}
+
+std::shared_ptr<Peer> PeerManager::addPeer(Type::connection_ptr con,
+                                           int64_t from_pid,
+                                           std::string_view name) {
     LOG4CXX_INFO(logger_, "name: " << name << " which from "
                                    << con->get_remote_endpoint()
                                    << " want to login system");
-    {
-        std::lock_guard<std::mutex> lock(mu_);
-        if (peers_.find(from_pid) != peers_.end()) {
-            while (peers_.find(next_id_) != peers_.end()) next_id_++;
-            from_pid = next_id_++;
-        }
-        if (peers_.find(from_pid) != peers_.end()) {
-            LOG4CXX_WARN(logger_, "pid:" << from_pid << " already log in!");
-            response(con, "you have already log in system!");
-            return;
-        }
-        peers_.emplace(from_pid, std::make_shared<Peer>(from_pid, con, name));
+    // 重连时优先要回原来的pid, 已被别人用了就分配新的
+    int64_t pid = from_pid >= 0 && ids_.claim(from_pid) ? from_pid
+                                                         : ids_.allocate();
+    if (pid < 0) {
+        LOG4CXX_ERROR(logger_, "no pid left for " << name);
+        return {};
+    }
+    std::shared_ptr<Peer> peer =
+        std::make_shared<Peer>(pid, con, std::string(name));
+    // pid已经从ids_拿到, 表里还有同一个pid说明分配器和表不一致,
+    // 这时不动名字索引, 也不释放pid(它仍属于表里的那个peer)
+    if (!peers_.insert(pid, peer)) {
+        LOG4CXX_ERROR(logger_, "pid " << pid << " already in peer table");
+        return {};
+    }
+    names_.add(peer->name(), peer->id());
+    LOG4CXX_INFO(logger_, "pid:" << peer->id() << " success log in.");
+    return peer;
+}
+
+void PeerManager::removePeer(int64_t pid) {
+    std::shared_ptr<Peer> peer = peers_.find(pid);
+    if (peer)
+        erasePeer(peer);
+}
+
+void PeerManager::erasePeer(const std::shared_ptr<Peer>& peer) {
+    if (peers_.erase(peer->id(), peer.get())) {
+        names_.remove(peer->name(), peer->id());
+        ids_.release(peer->id());
     }
-    LOG4CXX_INFO(logger_, "pid:" << from_pid << " success log in.");
-    response(con, "success",
-             {"pid", std::to_string(from_pid), "type", "logIn"});
 }
 
 void PeerManager::logOut(Type::connection_ptr con, int64_t from_pid) {
     LOG4CXX_INFO(logger_,
                  "from_pid: " << from_pid << " want to log out from .");
-    std::lock_guard<std::mutex> lock(mu_);
-    auto p = peers_.find(from_pid);
-    if (p == peers_.end()) {
+    std::shared_ptr<Peer> peer = peers_.find(from_pid);
+    if (!peer) {
         LOG4CXX_INFO(logger_, from_pid << " has already log out!");
-    } else if (p->second->peer_status_.getRoomID() != -1) {
+    } else if (peer->peer_status_.getRoomID() != -1) {
         LOG4CXX_INFO(logger_, from_pid << " should left room first");
         response(con, "you should left room before log out!");
         return;
     } else {
-        peers_.erase(p);
+        erasePeer(peer);
     }
     LOG4CXX_INFO(logger_, from_pid << " log out from system.");
     return;
@@ -81,49 +93,77 @@ void PeerManager::searchPeer(Type::connection_ptr con, int64_t from_pid,
     LOG4CXX_INFO(
         logger_,
         "from_pid: " << from_pid << " want to search dest_pid: " << dest_pid);
-    std::lock_guard<std::mutex> plock(mu_);
-    const auto& peer = peers_.find(dest_pid);
-    if (peer == peers_.end()) {
+    std::shared_ptr<Peer> peer = peers_.find(dest_pid);
+    if (!peer) {
         LOG4CXX_WARN(logger_, dest_pid << " not in system.");
         response(con, "pid " + std::to_string(from_pid) + " not in system.");
         return;
     }
     response(con, "success",
              {"pid", std::to_string(dest_pid), "type", "searchPeer", "name",
-              peer->second->name()});
+              peer->name()});
 }
 
 void PeerManager::searchPeer(Type::connection_ptr con, int64_t from_pid,
-                             const std::string& name) {
+                             std::string_view name) {
     LOG4CXX_INFO(logger_,
                  "from_pid: " << from_pid << " want to search name: " << name);
-    std::lock_guard<std::mutex> plock(mu_);
-    for (const auto& peer : peers_) {
-        if (peer.second->name() == name) {
-            response(con, "success",
-                     {"pid", std::to_string(peer.first), "type", "searchPeer",
-                      "name", peer.second->name()});
-            return;
-        }
+    std::vector<int64_t> pids = names_.find(name);
+    if (!pids.empty()) {
+        response(con, "success",
+                 {"pid", std::to_string(pids.front()), "type", "searchPeer",
+                  "name", std::string(name)});
+        return;
     }
-    response(con, "name " + name + " not in system.");
+    response(con, "name " + std::string(name) + " not in system.");
+}
+
+void PeerManager::searchPeerPrefix(Type::connection_ptr con, int64_t from_pid,
+                                   std::string_view prefix,
+                                   const NameIndex::Entry* after,
+                                   size_t limit) {
+    LOG4CXX_INFO(logger_, "from_pid: " << from_pid
+                                       << " want to search prefix: " << prefix
+                                       << ", limit: " << limit);
+    limit = std::max<size_t>(1, std::min(limit, kMaxSearchLimit));
+    std::vector<NameIndex::Entry> found;
+    found.reserve(limit);
+    bool more = names_.prefix(prefix, after, limit, &found);
+    rapidjson::Document d;
+    d.SetObject();
+    d.AddMember("msg", "success", d.GetAllocator());
+    d.AddMember("type", "searchPeer", d.GetAllocator());
+    rapidjson::Value peers(rapidjson::kArrayType);
+    for (auto& entry : found) {
+        rapidjson::Value p(rapidjson::kObjectType);
+        p.AddMember("pid", entry.second, d.GetAllocator());
+        p.AddMember("name", rapidjson::Value(jsonRef(entry.first)),
+                    d.GetAllocator());
+        peers.PushBack(p, d.GetAllocator());
+    }
+    d.AddMember("peers", peers, d.GetAllocator());
+    d.AddMember("more", more, d.GetAllocator());
+    if (more && !found.empty()) {
+        // 下一页的游标, 原样放进请求的after
+        rapidjson::Value next(rapidjson::kObjectType);
+        next.AddMember("name", rapidjson::Value(jsonRef(found.back().first)),
+                       d.GetAllocator());
+        next.AddMember("pid", found.back().second, d.GetAllocator());
+        d.AddMember("next", next, d.GetAllocator());
+    }
+    reply(con, getString(d));
 }
 
 void PeerManager::sendTo(Type::connection_ptr con, int64_t from_pid,
-                         int64_t dest_pid, const std::string& msg) {
+                         int64_t dest_pid, std::string_view msg) {
     LOG4CXX_INFO(logger_, "from_pid: " << from_pid << " want to send msg: "
                                        << msg << "to dest_pid: " << dest_pid);
 
-    std::unordered_map<int64_t, std::shared_ptr<Peer>>::iterator peer;
-    {
-        std::lock_guard<std::mutex> plock(mu_);
-        peer = peers_.find(dest_pid);
-        if (peer == peers_.end()) {
-            LOG4CXX_WARN(logger_, dest_pid << " not in system.");
-            response(con,
-                     "pid " + std::to_string(from_pid) + " not in system.");
-            return;
-        }
+    std::shared_ptr<Peer> peer = peers_.find(dest_pid);
+    if (!peer) {
+        LOG4CXX_WARN(logger_, dest_pid << " not in system.");
+        response(con, "pid " + std::to_string(from_pid) + " not in system.");
+        return;
     }
     try {
         rapidjson::Document d;
@@ -132,20 +172,15 @@ void PeerManager::sendTo(Type::connection_ptr con, int64_t from_pid,
         d.AddMember("from", "peer", d.GetAllocator());
         d.AddMember("from_pid", from_pid, d.GetAllocator());
         d.AddMember("msg", "text", d.GetAllocator());
-        d.AddMember("text", rapidjson::Value(msg.c_str(), d.GetAllocator()),
-                    d.GetAllocator());
-        peer->second->sendMsg(getString(d));
+        d.AddMember("text", rapidjson::Value(jsonRef(msg)), d.GetAllocator());
+        peer->sendMsg(d, OutboundQueue::CHAT, msg.size() + 128);
     } catch (std::exception const& e) {
         LOG4CXX_ERROR(logger_, e.what());
         response(con, "failed to send msg to pid " + std::to_string(from_pid));
-        peers_.erase(peer);
+        erasePeer(peer);
     }
 }
 
 std::shared_ptr<Peer> PeerManager::getPeer(int64_t pid) {
-    std::lock_guard<std::mutex> plock(mu_);
-    auto peer = peers_.find(pid);
-    if (peer == peers_.end())
-        return std::shared_ptr<Peer>();
-    return peer->second;
+    return peers_.find(pid);
 }
@@ -2,12 +2,14 @@
 #define _PEERMANAGER_H_
 
 #include <memory>
-#include <mutex>
-#include <unordered_map>
+#include <string_view>
 
+#include "idAllocator.h"
 #include "log4cxx/log4cxx.h"
 #include "log4cxx/logger.h"
+#include "nameIndex.h"
 #include "peer.h"
+#include "peerTable.h"
 #include "type.h"
 
 class PeerManager {
@@ -19,24 +21,40 @@ public:
     ~PeerManager();
 
     // 用户注册id
-    void logIn(Type::connection_ptr con, const std::string& name);
+    void logIn(Type::connection_ptr con, std::string_view name);
     void logIn(Type::connection_ptr con, int64_t from_pid,
-               const std::string& name);
+               std::string_view name);
     void logOut(Type::connection_ptr con, int64_t from_pid);
     void searchPeer(Type::connection_ptr con, int64_t from_pid,
                     int64_t dest_pid);
     void searchPeer(Type::connection_ptr con, int64_t from_pid,
-                    const std::string& name);
+                    std::string_view name);
+    // 名字以prefix开头的peer, 按(name, pid)排序, 从after之后最多取limit个,
+    // limit限制在[1, kMaxSearchLimit]. 还有更多时回复里的next作为下一页的after
+    void searchPeerPrefix(Type::connection_ptr con, int64_t from_pid,
+                          std::string_view prefix,
+                          const NameIndex::Entry *after, size_t limit);
     // 给pid发消息
     void sendTo(Type::connection_ptr con, int64_t from_pid, int64_t dest_pid,
-                const std::string& msg);
+                std::string_view msg);
     std::shared_ptr<Peer> getPeer(int64_t pid);
+    // 注册peer, from_pid小于0或不能要回时分配新的pid, 不回复客户端.
+    // pid用完时返回空
+    std::shared_ptr<Peer> addPeer(Type::connection_ptr con, int64_t from_pid,
+                                  std::string_view name);
+    // 组合操作失败时撤销addPeer, 连接断开时登出
+    void removePeer(int64_t pid);
+    static constexpr size_t kDefaultSearchLimit = 20;
+    static constexpr size_t kMaxSearchLimit = 100;
+
 private:
     PeerManager();
+    // pid还对应peer时从表和名字索引中删除
+    void erasePeer(const std::shared_ptr<Peer>& peer);
 
-    std::unordered_map<int64_t, std::shared_ptr<Peer>> peers_;
-    std::mutex mu_;
-    int64_t next_id_;
+    PeerTable peers_;
+    NameIndex names_;
+    IdAllocator ids_;
     static log4cxx::LoggerPtr logger_;
 };
 
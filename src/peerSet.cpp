@@ -0,0 +1,52 @@
+#include "peerSet.h"
+
+PeerSet::PeerSet() : peers_(std::make_shared<const Map>()) {}
+
+PeerSet::PeerSet(const PeerSet &other) : peers_(other.snapshot()) {}
+
+PeerSet &PeerSet::operator=(const PeerSet &other) {
+    Snapshot peers = other.snapshot();
+    std::lock_guard<std::mutex> lock(mu_);
+    std::atomic_store(&peers_, peers);
+    return *this;
+}
+
+bool PeerSet::add(int64_t pid, const std::shared_ptr<Peer> &peer) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (peers_->find(pid) != peers_->end())
+        return false;
+    std::shared_ptr<Map> peers = std::make_shared<Map>(*peers_);
+    peers->emplace(pid, peer);
+    std::atomic_store(&peers_, Snapshot(std::move(peers)));
+    return true;
+}
+
+std::shared_ptr<Peer> PeerSet::remove(int64_t pid) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto p = peers_->find(pid);
+    if (p == peers_->end())
+        return {};
+    std::shared_ptr<Peer> removed = p->second;
+    std::shared_ptr<Map> peers = std::make_shared<Map>(*peers_);
+    peers->erase(pid);
+    std::atomic_store(&peers_, Snapshot(std::move(peers)));
+    return removed;
+}
+
+void PeerSet::clear() {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::atomic_store(&peers_, std::make_shared<const Map>());
+}
+
+std::shared_ptr<Peer> PeerSet::find(int64_t pid) const {
+    Snapshot peers = snapshot();
+    auto p = peers->find(pid);
+    return p == peers->end() ? std::shared_ptr<Peer>() : p->second;
+}
+
+bool PeerSet::contains(int64_t pid) const {
+    Snapshot peers = snapshot();
+    return peers->find(pid) != peers->end();
+}
+
+bool PeerSet::empty() const { return snapshot()->empty(); }
@@ -0,0 +1,42 @@
+#ifndef _PEERSET_H_
+#define _PEERSET_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "peer.h"
+
+// 房间成员表, copy-on-write: 成员变化时复制一份新表整体替换,
+// 读者拿到的快照是不可变的, 遍历和发送时不需要持有任何锁.
+// 加入/离开是O(成员数)的复制, 换来广播和查找不再互相阻塞
+class PeerSet {
+public:
+    typedef std::unordered_map<int64_t, std::shared_ptr<Peer>> Map;
+    typedef std::shared_ptr<const Map> Snapshot;
+
+    PeerSet();
+    PeerSet(const PeerSet &other);
+    PeerSet &operator=(const PeerSet &other);
+
+    // 当前成员的快照, 之后的变化不会影响它
+    Snapshot snapshot() const { return std::atomic_load(&peers_); }
+
+    // pid已存在时返回false
+    bool add(int64_t pid, const std::shared_ptr<Peer> &peer);
+    // 返回被移除的peer, 不存在时返回空
+    std::shared_ptr<Peer> remove(int64_t pid);
+    void clear();
+
+    std::shared_ptr<Peer> find(int64_t pid) const;
+    bool contains(int64_t pid) const;
+    bool empty() const;
+
+private:
+    // 只用来串行化写者, 读者不加锁
+    std::mutex mu_;
+    Snapshot peers_;
+};
+
+#endif  // _PEERSET_H_
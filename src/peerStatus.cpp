@@ -1,164 +1,125 @@
 #include "peerStatus.h"
 
-#include "util.h"
-
 PeerStatus::PeerStatus()
-    : room_id_(-1),
-      wasInSession_(false),
-      isInSession_(false),
-      cameraUsing_(false),
-      cameraUsed_(false),
-      audioUsing_(false),
-      audioUsed_(false),
-      screenUsing_(false),
-      screenUsed_(false),
-      sendOffer_(false),
-      receiveOffer_(false),
-      sendAnswer_(false),
-      receiveAnswer_(false),
-      sendCandidate_(false),
-      receiveCandidate_(false),
-      connected_(false) {}
-
-int64_t PeerStatus::getRoomID() { return room_id_; }
-
-void PeerStatus::setRoomID(int64_t room_id) { room_id_ = room_id; }
-
-bool PeerStatus::isInSession() const { return isInSession_; }
-
-bool PeerStatus::wasInSession() const { return wasInSession_; }
+    : flags_(0), room_id_(-1), join_time_(0), left_time_(0) {}
+
+PeerStatus::PeerStatus(const PeerStatus &other)
+    : flags_(other.flags()),
+      room_id_(other.room_id_.load()),
+      join_time_(other.join_time_.load()),
+      left_time_(other.left_time_.load()) {}
 
+PeerStatus &PeerStatus::operator=(const PeerStatus &other) {
+    flags_.store(other.flags());
+    room_id_.store(other.room_id_.load());
+    join_time_.store(other.join_time_.load());
+    left_time_.store(other.left_time_.load());
+    return *this;
+}
+
+void PeerStatus::update(bool on, uint32_t set, uint32_t clear) {
+    if (on)
+        flags_.fetch_or(set, std::memory_order_acq_rel);
+    else
+        flags_.fetch_and(~clear, std::memory_order_acq_rel);
+}
+
+int64_t PeerStatus::getRoomID() { return room_id_.load(); }
+
+void PeerStatus::setRoomID(int64_t room_id) { room_id_.store(room_id); }
+
+bool PeerStatus::isInSession() const { return has(flags(), IN_SESSION); }
+
+bool PeerStatus::wasInSession() const { return has(flags(), WAS_IN_SESSION); }
+
+// 进入会话时同时记下曾经在会话中, 一次原子操作完成
 void PeerStatus::setIsInSession(bool isInSession) {
-    isInSession_ = isInSession;
-    if (isInSession)
-        wasInSession_ = true;
+    update(isInSession, IN_SESSION | WAS_IN_SESSION, IN_SESSION);
 }
 
-bool PeerStatus::isCameraUsing() const { return cameraUsing_; }
+bool PeerStatus::isCameraUsing() const { return has(flags(), CAMERA_USING); }
 
 void PeerStatus::setCameraUsing(bool cameraUsing) {
-    cameraUsing_ = cameraUsing;
-    if (cameraUsing)
-        cameraUsed_ = true;
+    update(cameraUsing, CAMERA_USING | CAMERA_USED, CAMERA_USING);
 }
 
-bool PeerStatus::isCameraUsed() const { return cameraUsed_; }
+bool PeerStatus::isCameraUsed() const { return has(flags(), CAMERA_USED); }
 
-bool PeerStatus::isAudioUsing() const { return audioUsing_; }
+bool PeerStatus::isAudioUsing() const { return has(flags(), AUDIO_USING); }
 
 void PeerStatus::setAudioUsing(bool audioUsing) {
-    audioUsing_ = audioUsing;
-    if (audioUsing)
-        audioUsed_ = true;
+    update(audioUsing, AUDIO_USING | AUDIO_USED, AUDIO_USING);
 }
 
-bool PeerStatus::isAudioUsed() const { return audioUsed_; }
+bool PeerStatus::isAudioUsed() const { return has(flags(), AUDIO_USED); }
 
-bool PeerStatus::isScreenUsing() const { return screenUsing_; }
+bool PeerStatus::isScreenUsing() const { return has(flags(), SCREEN_USING); }
 
 void PeerStatus::setScreenUsing(bool screenUsing) {
-    screenUsing_ = screenUsing;
-    if (screenUsing)
-        screenUsed_ = true;
+    update(screenUsing, SCREEN_USING | SCREEN_USED, SCREEN_USING);
 }
 
-bool PeerStatus::isScreenUsed() const { return screenUsed_; }
+bool PeerStatus::isScreenUsed() const { return has(flags(), SCREEN_USED); }
 
-bool PeerStatus::isSendOffer() const { return sendOffer_; }
+bool PeerStatus::isSendOffer() const { return has(flags(), SEND_OFFER); }
 
-void PeerStatus::setSendOffer(bool sendOffer) { sendOffer_ = sendOffer; }
+void PeerStatus::setSendOffer(bool sendOffer) {
+    update(sendOffer, SEND_OFFER, SEND_OFFER);
+}
 
-bool PeerStatus::isReceiveOffer() const { return receiveOffer_; }
+bool PeerStatus::isReceiveOffer() const { return has(flags(), RECEIVE_OFFER); }
 
 void PeerStatus::setReceiveOffer(bool receiveOffer) {
-    receiveOffer_ = receiveOffer;
+    update(receiveOffer, RECEIVE_OFFER, RECEIVE_OFFER);
 }
 
-bool PeerStatus::isSendAnswer() const { return sendAnswer_; }
+bool PeerStatus::isSendAnswer() const { return has(flags(), SEND_ANSWER); }
 
-void PeerStatus::setSendAnswer(bool sendAnswer) { sendAnswer_ = sendAnswer; }
+void PeerStatus::setSendAnswer(bool sendAnswer) {
+    update(sendAnswer, SEND_ANSWER, SEND_ANSWER);
+}
 
-bool PeerStatus::isReceiveAnswer() const { return receiveAnswer_; }
+bool PeerStatus::isReceiveAnswer() const {
+    return has(flags(), RECEIVE_ANSWER);
+}
 
 void PeerStatus::setReceiveAnswer(bool receiveAnswer) {
-    receiveAnswer_ = receiveAnswer;
+    update(receiveAnswer, RECEIVE_ANSWER, RECEIVE_ANSWER);
 }
 
-bool PeerStatus::isSendCandidate() const { return sendCandidate_; }
+bool PeerStatus::isSendCandidate() const {
+    return has(flags(), SEND_CANDIDATE);
+}
 
 void PeerStatus::setSendCandidate(bool sendCandidate) {
-    sendCandidate_ = sendCandidate;
+    update(sendCandidate, SEND_CANDIDATE, SEND_CANDIDATE);
 }
 
-bool PeerStatus::isReceiveCandidate() const { return receiveCandidate_; }
+bool PeerStatus::isReceiveCandidate() const {
+    return has(flags(), RECEIVE_CANDIDATE);
+}
 
 void PeerStatus::setReceiveCandidate(bool receiveCandidate) {
-    receiveCandidate_ = receiveCandidate;
+    update(receiveCandidate, RECEIVE_CANDIDATE, RECEIVE_CANDIDATE);
+}
+
+bool PeerStatus::isConnected() const { return has(flags(), CONNECTED); }
+
+void PeerStatus::setConnected(bool connected) {
+    update(connected, CONNECTED, CONNECTED);
 }
 
-bool PeerStatus::isConnected() const { return connected_; }
+int64_t PeerStatus::joinTime() const { return join_time_.load(); }
+
+void PeerStatus::setJoinTime(int64_t time) { join_time_.store(time); }
+
+int64_t PeerStatus::leftTime() const { return left_time_.load(); }
 
-void PeerStatus::setConnected(bool connected) { connected_ = connected; }
+void PeerStatus::setLeftTime(int64_t time) { left_time_.store(time); }
 
+// 清空会话相关的状态, 房间号保留
 void PeerStatus::reset() {
-    wasInSession_ = false;
-    isInSession_ = false;
-    cameraUsing_ = false;
-    cameraUsed_ = false;
-    audioUsing_ = false;
-    audioUsed_ = false;
-    screenUsing_ = false;
-    screenUsed_ = false;
-    sendOffer_ = false;
-    receiveOffer_ = false;
-    sendAnswer_ = false;
-    receiveAnswer_ = false;
-    sendCandidate_ = false;
-    receiveCandidate_ = false;
-    connected_ = false;
-    join_time_.clear();
-    left_time_.clear();
-}
-
-PeerStatus::PeerStatus(const PeerStatus &other) {
-    room_id_ = other.room_id_;
-    join_time_ = other.join_time_;
-    left_time_ = other.left_time_;
-    wasInSession_ = other.wasInSession_;
-    isInSession_ = other.isInSession_;
-    cameraUsing_ = other.cameraUsing_;
-    cameraUsed_ = other.cameraUsed_;
-    audioUsing_ = other.audioUsing_;
-    audioUsed_ = other.audioUsed_;
-    screenUsing_ = other.screenUsing_;
-    screenUsed_ = other.screenUsed_;
-    sendOffer_ = other.sendOffer_;
-    receiveOffer_ = other.receiveOffer_;
-    sendAnswer_ = other.sendAnswer_;
-    receiveAnswer_ = other.receiveAnswer_;
-    sendCandidate_ = other.sendCandidate_;
-    receiveCandidate_ = other.receiveCandidate_;
-    connected_ = other.connected_;
+    flags_.store(0, std::memory_order_release);
+    join_time_.store(0);
+    left_time_.store(0);
 }
-
-PeerStatus &PeerStatus::operator=(const PeerStatus &other) {
-    room_id_ = other.room_id_;
-    join_time_ = other.join_time_;
-    left_time_ = other.left_time_;
-    wasInSession_ = other.wasInSession_;
-    isInSession_ = other.isInSession_;
-    cameraUsing_ = other.cameraUsing_;
-    cameraUsed_ = other.cameraUsed_;
-    audioUsing_ = other.audioUsing_;
-    audioUsed_ = other.audioUsed_;
-    screenUsing_ = other.screenUsing_;
-    screenUsed_ = other.screenUsed_;
-    sendOffer_ = other.sendOffer_;
-    receiveOffer_ = other.receiveOffer_;
-    sendAnswer_ = other.sendAnswer_;
-    receiveAnswer_ = other.receiveAnswer_;
-    sendCandidate_ = other.sendCandidate_;
-    receiveCandidate_ = other.receiveCandidate_;
-    connected_ = other.connected_;
-    return *this;
-}
\ No newline at end of file
@@ -1,18 +1,44 @@
 #ifndef _PEERSTATUS_H_
 #define _PEERSTATUS_H_
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 
-// peer status about room/session
+// peer status about room/session.
+// 所有标志位放在一个原子的uint32里, 各worker无锁地置位/清除,
+// 读整个状态只需要一次load; 时间是unix秒
 class PeerStatus {
 public:
+    enum Flag : uint32_t {
+        IN_SESSION = 1u << 0,
+        // if true, status to sql
+        WAS_IN_SESSION = 1u << 1,
+        CAMERA_USING = 1u << 2,
+        CAMERA_USED = 1u << 3,
+        AUDIO_USING = 1u << 4,
+        AUDIO_USED = 1u << 5,
+        SCREEN_USING = 1u << 6,
+        SCREEN_USED = 1u << 7,
+        SEND_OFFER = 1u << 8,
+        RECEIVE_OFFER = 1u << 9,
+        SEND_ANSWER = 1u << 10,
+        RECEIVE_ANSWER = 1u << 11,
+        SEND_CANDIDATE = 1u << 12,
+        RECEIVE_CANDIDATE = 1u << 13,
+        CONNECTED = 1u << 14,
+    };
+
     PeerStatus();
     PeerStatus(const PeerStatus&);
     PeerStatus& operator=(const PeerStatus&);
 
     void reset();
 
+    // 所有标志位的快照, 用has判断
+    uint32_t flags() const { return flags_.load(std::memory_order_acquire); }
+    static bool has(uint32_t flags, Flag flag) { return (flags & flag) != 0; }
+
     int64_t getRoomID();
 
     void setRoomID(int64_t);
@@ -69,26 +95,19 @@ public:
 
     void setConnected(bool connected);
 
-    std::string join_time_;
-    std::string left_time_;
+    int64_t joinTime() const;
+    void setJoinTime(int64_t time);
+    int64_t leftTime() const;
+    void setLeftTime(int64_t time);
+
 private:
-    int64_t room_id_;
-    bool isInSession_;
-    // if true, status to sql
-    bool wasInSession_;
-    bool cameraUsing_;
-    bool cameraUsed_;
-    bool audioUsing_;
-    bool audioUsed_;
-    bool screenUsing_;
-    bool screenUsed_;
-    bool sendOffer_;
-    bool receiveOffer_;
-    bool sendAnswer_;
-    bool receiveAnswer_;
-    bool sendCandidate_;
-    bool receiveCandidate_;
-    bool connected_;
+    // on为true时置上set, 否则清除clear, 各是一次fetch_or/fetch_and
+    void update(bool on, uint32_t set, uint32_t clear);
+
+    std::atomic<uint32_t> flags_;
+    std::atomic<int64_t> room_id_;
+    std::atomic<int64_t> join_time_;
+    std::atomic<int64_t> left_time_;
 };
 
-#endif  // _PEERSTATUS_H_
\ No newline at end of file
+#endif  // _PEERSTATUS_H_
@@ -0,0 +1,36 @@
+#include "peerTable.h"
+
+PeerTable::PeerTable() : size_(0) {}
+
+std::shared_ptr<Peer> PeerTable::find(int64_t pid) const {
+    const Shard &shard = shardOf(pid);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto p = shard.peers.find(pid);
+    return p == shard.peers.end() ? std::shared_ptr<Peer>() : p->second;
+}
+
+bool PeerTable::contains(int64_t pid) const {
+    const Shard &shard = shardOf(pid);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    return shard.peers.find(pid) != shard.peers.end();
+}
+
+bool PeerTable::insert(int64_t pid, const std::shared_ptr<Peer> &peer) {
+    Shard &shard = shardOf(pid);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    if (!shard.peers.emplace(pid, peer).second)
+        return false;
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool PeerTable::erase(int64_t pid, const Peer *expected) {
+    Shard &shard = shardOf(pid);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto p = shard.peers.find(pid);
+    if (p == shard.peers.end() || (expected && p->second.get() != expected))
+        return false;
+    shard.peers.erase(p);
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
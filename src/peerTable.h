@@ -0,0 +1,51 @@
+#ifndef _PEERTABLE_H_
+#define _PEERTABLE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "peer.h"
+
+// 全局在线peer表, 按pid分成kShardCount个分片, 每个分片一把锁.
+// 不同pid的查找/登录/登出基本落在不同分片上, 不再争用同一把全局锁
+class PeerTable {
+public:
+    typedef std::unordered_map<int64_t, std::shared_ptr<Peer>> Map;
+
+    PeerTable();
+    PeerTable(const PeerTable &) = delete;
+    PeerTable &operator=(const PeerTable &) = delete;
+
+    std::shared_ptr<Peer> find(int64_t pid) const;
+    bool contains(int64_t pid) const;
+    // pid已存在时返回false
+    bool insert(int64_t pid, const std::shared_ptr<Peer> &peer);
+    // expected非空时只有pid对应的还是expected才删除, 删除了返回true
+    bool erase(int64_t pid, const Peer *expected = nullptr);
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+    static const int kShardBits = 6;
+    static const int kShardCount = 1 << kShardBits;
+
+    // 独占缓存行, 相邻分片的锁不会互相伪共享
+    struct alignas(64) Shard {
+        mutable std::mutex mu;
+        Map peers;
+    };
+
+    Shard &shardOf(int64_t pid) {
+        return shards_[static_cast<uint64_t>(pid) & (kShardCount - 1)];
+    }
+    const Shard &shardOf(int64_t pid) const {
+        return shards_[static_cast<uint64_t>(pid) & (kShardCount - 1)];
+    }
+
+    Shard shards_[kShardCount];
+    std::atomic<size_t> size_;
+};
+
+#endif  // _PEERTABLE_H_
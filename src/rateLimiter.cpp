@@ -0,0 +1,61 @@
+#include "rateLimiter.h"
+
+#include <chrono>
+
+RateLimiter::RateLimiter() {
+    // 默认值: 协商阶段ICE candidate会集中到达, 给较大的突发;
+    // 目录查询开销大, 限得最紧
+    setConnectionLimit(200, 400);
+    setLaneLimit(NEGOTIATION, 100, 200);
+    setLaneLimit(SESSION_CONTROL, 20, 40);
+    setLaneLimit(MESSAGING, 20, 40);
+    setLaneLimit(QUERY, 5, 10);
+    for (int i = 0; i < LANE_COUNT; i++) {
+        dropped_[i] = 0;
+    }
+}
+
+RateLimiter::Limit RateLimiter::makeLimit(double rate, double burst) {
+    Limit limit = {0, 0};
+    if (rate <= 0)
+        return limit;
+    if (burst < 1)
+        burst = 1;
+    limit.interval_us = static_cast<int64_t>(1000000 / rate);
+    if (limit.interval_us < 1)
+        limit.interval_us = 1;
+    limit.tolerance_us = static_cast<int64_t>((burst - 1) * limit.interval_us);
+    return limit;
+}
+
+void RateLimiter::setConnectionLimit(double rate, double burst) {
+    connection_ = makeLimit(rate, burst);
+}
+
+void RateLimiter::setLaneLimit(int lane, double rate, double burst) {
+    if (lane < 0 || lane >= LANE_COUNT)
+        return;
+    lanes_[lane] = makeLimit(rate, burst);
+}
+
+bool RateLimiter::consume(TokenBucket &bucket, const Limit &limit,
+                          int64_t now_us) {
+    return limit.interval_us == 0 ||
+           bucket.consume(now_us, limit.interval_us, limit.tolerance_us);
+}
+
+bool RateLimiter::allow(ConnectionData *data, int lane) {
+    int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch())
+                         .count();
+    if (consume(data->total_, connection_, now_us) &&
+        consume(data->lanes_[lane], lanes_[lane], now_us))
+        return true;
+    dropped_[lane].fetch_add(1, std::memory_order_relaxed);
+    data->dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+uint64_t RateLimiter::dropped(int lane) const {
+    return dropped_[lane].load(std::memory_order_relaxed);
+}
@@ -0,0 +1,43 @@
+#ifndef _RATELIMITER_H_
+#define _RATELIMITER_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "connectionData.h"
+#include "operate.h"
+
+// on_message入口处的限流, 超限的消息在进入WorkerPool之前直接丢弃.
+// 每个连接一个总的令牌桶, 另外每类操作(LANE)一个令牌桶.
+// 参数需要在server开始run之前设置
+class RateLimiter {
+public:
+    RateLimiter();
+    RateLimiter(const RateLimiter &) = delete;
+    RateLimiter &operator=(const RateLimiter &) = delete;
+
+    // rate: 每秒生成的令牌数, <= 0表示不限; burst: 桶的容量
+    void setConnectionLimit(double rate, double burst);
+    void setLaneLimit(int lane, double rate, double burst);
+
+    // 每条消息调用一次, 返回false表示应该丢弃
+    bool allow(ConnectionData *data, int lane);
+
+    uint64_t dropped(int lane) const;
+
+private:
+    struct Limit {
+        // 0表示不限
+        int64_t interval_us;
+        int64_t tolerance_us;
+    };
+
+    static Limit makeLimit(double rate, double burst);
+    static bool consume(TokenBucket &bucket, const Limit &limit, int64_t now_us);
+
+    Limit connection_;
+    Limit lanes_[LANE_COUNT];
+    std::atomic<uint64_t> dropped_[LANE_COUNT];
+};
+
+#endif  // _RATELIMITER_H_
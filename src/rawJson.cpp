@@ -0,0 +1,162 @@
+#include "rawJson.h"
+
+#include <cctype>
+#include <charconv>
+
+bool peekInt64(std::string_view payload, const char *key, int64_t *value) {
+    // 只看顶层字段, 跳过字符串内容, 文本里转义的"rid":5不会被当成字段
+    RawField field = {key, {}};
+    return scanFields(payload, &field, 1) && rawToInt64(field.raw, value);
+}
+
+static size_t skipSpace(std::string_view s, size_t i) {
+    while (i < s.size() && std::isspace((unsigned char)s[i])) i++;
+    return i;
+}
+
+// i指向开头的引号, 返回结尾引号之后的位置; 转义不合法时返回npos,
+// 保证原样转发出去的字符串仍然是合法的json
+static size_t skipString(std::string_view s, size_t i) {
+    for (i++; i < s.size(); i++) {
+        unsigned char c = s[i];
+        if (c == '"')
+            return i + 1;
+        if (c < 0x20)
+            return std::string_view::npos;
+        if (c != '\\')
+            continue;
+        if (++i >= s.size())
+            return std::string_view::npos;
+        switch (s[i]) {
+            case '"':
+            case '\\':
+            case '/':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+                break;
+            case 'u':
+                if (i + 4 >= s.size())
+                    return std::string_view::npos;
+                for (int k = 1; k <= 4; k++) {
+                    if (!std::isxdigit((unsigned char)s[i + k]))
+                        return std::string_view::npos;
+                }
+                i += 4;
+                break;
+            default:
+                return std::string_view::npos;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// 跳过一个值, 对象和数组只匹配括号不检查内部
+static size_t skipValue(std::string_view s, size_t i) {
+    if (i >= s.size())
+        return std::string_view::npos;
+    char c = s[i];
+    if (c == '"')
+        return skipString(s, i);
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        while (i < s.size()) {
+            c = s[i];
+            if (c == '"') {
+                i = skipString(s, i);
+                if (i == std::string_view::npos)
+                    return i;
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0)
+                    return i + 1;
+            }
+            i++;
+        }
+        return std::string_view::npos;
+    }
+    size_t begin = i;
+    while (i < s.size() && (std::isalnum((unsigned char)s[i]) || s[i] == '-' ||
+                            s[i] == '+' || s[i] == '.'))
+        i++;
+    return i == begin ? std::string_view::npos : i;
+}
+
+bool scanFields(std::string_view payload, RawField *fields, size_t count) {
+    const std::string_view &s = payload;
+    size_t found = 0;
+    for (size_t k = 0; k < count; k++) {
+        fields[k].raw = std::string_view();
+    }
+    size_t i = skipSpace(s, 0);
+    if (i >= s.size() || s[i] != '{')
+        return false;
+    i = skipSpace(s, i + 1);
+    if (i < s.size() && s[i] == '}')
+        return true;
+    for (;;) {
+        if (i >= s.size() || s[i] != '"')
+            return false;
+        size_t key_end = skipString(s, i);
+        if (key_end == std::string_view::npos)
+            return false;
+        std::string_view key = s.substr(i + 1, key_end - i - 2);
+        i = skipSpace(s, key_end);
+        if (i >= s.size() || s[i] != ':')
+            return false;
+        i = skipSpace(s, i + 1);
+        size_t end = skipValue(s, i);
+        if (end == std::string_view::npos)
+            return false;
+        for (size_t k = 0; k < count; k++) {
+            if (fields[k].raw.empty() && key == fields[k].key) {
+                fields[k].raw = s.substr(i, end - i);
+                if (++found == count)
+                    return true;
+                break;
+            }
+        }
+        i = skipSpace(s, end);
+        if (i < s.size() && s[i] == ',') {
+            i = skipSpace(s, i + 1);
+            continue;
+        }
+        return i < s.size() && s[i] == '}';
+    }
+}
+
+bool splitArray(std::string_view payload, std::vector<std::string_view> *items,
+                size_t max) {
+    const std::string_view &s = payload;
+    size_t i = skipSpace(s, 0);
+    if (i >= s.size() || s[i] != '[')
+        return false;
+    i = skipSpace(s, i + 1);
+    if (i < s.size() && s[i] == ']')
+        return true;
+    for (;;) {
+        size_t end = skipValue(s, i);
+        if (end == std::string_view::npos || items->size() >= max)
+            return false;
+        items->push_back(s.substr(i, end - i));
+        i = skipSpace(s, end);
+        if (i < s.size() && s[i] == ',') {
+            i = skipSpace(s, i + 1);
+            continue;
+        }
+        return i < s.size() && s[i] == ']';
+    }
+}
+
+bool rawToInt64(std::string_view raw, int64_t *value) {
+    if (raw.empty())
+        return false;
+    const char *end = raw.data() + raw.size();
+    std::from_chars_result res = std::from_chars(raw.data(), end, *value);
+    return res.ec == std::errc() && res.ptr == end;
+}
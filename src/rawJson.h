@@ -0,0 +1,32 @@
+#ifndef _RAWJSON_H_
+#define _RAWJSON_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// 不建DOM的json扫描, 用于入队前的路由和转发的快速路径.
+// 不依赖rapidjson和websocketpp
+
+// 不解析整个json, 只取顶层对象中"key":整数, 用于入队前的路由
+bool peekInt64(std::string_view payload, const char *key, int64_t *value);
+
+// 顶层对象中一个字段的原始json文本, 字符串值保留引号和转义
+struct RawField {
+    const char *key;
+    std::string_view raw;
+};
+
+// 只扫描顶层对象的字段, 不解码字符串也不建DOM, 所有字段都找到后提前返回.
+// 同名字段取第一个; 没找到的字段raw为空; 扫描到的部分格式不对时返回false
+bool scanFields(std::string_view payload, RawField *fields, size_t count);
+
+// 把顶层数组切成各个元素的原始json文本, 元素超过max个或格式不对时返回false
+bool splitArray(std::string_view payload, std::vector<std::string_view> *items,
+                size_t max);
+
+// raw是json整数时返回true
+bool rawToInt64(std::string_view raw, int64_t *value);
+
+#endif  // _RAWJSON_H_
@@ -6,18 +6,22 @@
 log4cxx::LoggerPtr Room::logger_ = log4cxx::Logger::getLogger("processor");
 
 Room::Room(int64_t id)
-    : id_(id), peers_(), mu_(), session_(&peers_, &mu_, id) {}
+    : id_(id), peers_(), mu_(), closed_(false), session_(&peers_, &mu_, id) {}
 
 Room::Room(const Room& other)
     : id_(other.id_),
       peers_(other.peers_),
       mu_(),
+      closed_(false),
       session_(&peers_, &mu_, other.id_) {}
 
 Room::Room(Room&& other)
-    : id_(other.id_), peers_(), mu_(), session_(&peers_, &mu_, other.id_) {
-    this->id_ = other.id_;
-    this->peers_.swap(other.peers_);
+    : id_(other.id_),
+      peers_(other.peers_),
+      mu_(),
+      closed_(false),
+      session_(&peers_, &mu_, other.id_) {
+    other.peers_.clear();
 }
 
 Room& Room::operator=(const Room& other) {
@@ -31,72 +35,81 @@ Room::~Room() {}
 
 bool Room::addPeer(int64_t pid, std::shared_ptr<Peer> peer) {
     std::lock_guard<std::mutex> lock(mu_);
-    if (peers_.find(pid) != peers_.end()) {
+    if (closed_) {
+        LOG4CXX_WARN(logger_, "room " << id_ << " closed, " << pid
+                                      << " can not join");
+        return false;
+    }
+    if (!peers_.add(pid, peer)) {
         LOG4CXX_WARN(logger_, pid << " already in Room");
     } else {
         peer->peer_status_.setRoomID(id_);
-        peers_.emplace(pid, peer);
     }
     return true;
 }
 
 bool Room::removePeer(int64_t pid) {
     std::lock_guard<std::mutex> lock(mu_);
-    if (peers_.find(pid) == peers_.end()) {
+    std::shared_ptr<Peer> peer = peers_.remove(pid);
+    if (!peer) {
         LOG4CXX_WARN(logger_, pid << " not in Room");
     } else {
-        peers_[pid]->peer_status_.setRoomID(-1);
-        peers_.erase(pid);
+        peer->peer_status_.setRoomID(-1);
+        session_.removeMember(pid);
     }
     return true;
 }
 
-bool Room::sendToRoom(int64_t from_pid, const std::string& msg) {
+// 判空和关闭在同一把锁下, 不会和并发的addPeer交错:
+// 要么加入者先进来房间不空, 要么房间先关闭加入失败
+bool Room::closeIfEmpty() {
     std::lock_guard<std::mutex> lock(mu_);
-    if (peers_.find(from_pid) == peers_.end()) {
+    if (!closed_ && peers_.empty())
+        closed_ = true;
+    return closed_;
+}
+
+bool Room::sendToRoom(int64_t from_pid, std::string_view msg) {
+    rapidjson::Document d;
+    d.SetObject();
+    d.AddMember("type", "text", d.GetAllocator());
+    d.AddMember("from", "room", d.GetAllocator());
+    d.AddMember("from_pid", from_pid, d.GetAllocator());
+    d.AddMember("msg", "text", d.GetAllocator());
+    d.AddMember("text", rapidjson::Value(jsonRef(msg)), d.GetAllocator());
+
+    // 在快照上发送, 不持有房间锁, 慢的接收者不会挡住加入/离开和其他广播
+    PeerSet::Snapshot peers = peers_.snapshot();
+    auto from = peers->find(from_pid);
+    if (from == peers->end()) {
         LOG4CXX_WARN(logger_, "pid: " << from_pid << " not in room " << id_
                                       << ", can not send msg to room.");
         return false;
     }
-    int len = peers_.size();
-    for (auto p = peers_.begin(); p != peers_.end();) {
+    // 只序列化一次, 所有成员共用同一个只读的消息
+    Type::message_ptr message =
+        makeMessage(from->second->getCon(), d, msg.size() + 128);
+    for (auto& p : *peers) {
         try {
-            rapidjson::Document d;
-            d.SetObject();
-            d.AddMember("type", "text", d.GetAllocator());
-            d.AddMember("from", "room", d.GetAllocator());
-            d.AddMember("from_pid", from_pid, d.GetAllocator());
-            d.AddMember("msg", "text", d.GetAllocator());
-            d.AddMember("text", rapidjson::Value(msg.c_str(), d.GetAllocator()),
-                        d.GetAllocator());
-            p->second->sendMsg(getString(d));
+            p.second->sendMsg(message, OutboundQueue::CHAT);
         } catch (std::exception const& e) {
             LOG4CXX_ERROR(logger_, e.what());
             LOG4CXX_ERROR(logger_, "failed to send msg to pid "
-                                       << p->first << "in room " << id_);
-            p = peers_.erase(p);
-            continue;
+                                       << p.first << "in room " << id_);
+            peers_.remove(p.first);
         }
-        ++p;
     }
     return true;
 };
 
-bool Room::isInroom(int64_t from_pid) {
-    std::lock_guard<std::mutex> lock(mu_);
-    return peers_.find(from_pid) != peers_.end();
-}
+bool Room::isInroom(int64_t from_pid) { return peers_.contains(from_pid); }
 
-bool Room::empty() {
-    std::lock_guard<std::mutex> lock(mu_);
-    return peers_.empty();
-}
+bool Room::empty() { return peers_.empty(); }
 
 void Room::getPeers(rapidjson::Document& d,rapidjson::Document::AllocatorType &allocator) {
-    std::lock_guard<std::mutex> lock(mu_);
     d.AddMember("rid", id_, allocator);
     rapidjson::Value ps(rapidjson::kArrayType);
-    for (auto& peer : peers_) {
+    for (auto& peer : *peers_.snapshot()) {
         rapidjson::Document p;
         p.SetObject();
         p.AddMember("pid", peer.second->id(), allocator);
@@ -7,12 +7,14 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
 
 #include "peer.h"
+#include "peerSet.h"
 #include "rapidjson/document.h"
 #include "rapidjson/rapidjson.h"
 #include "session.h"
@@ -30,9 +32,12 @@ public:
     Room& operator=(const Room&);
     ~Room();
 
+    // 房间已关闭(正在被删除)时返回false
     bool addPeer(int64_t pid, std::shared_ptr<Peer>);
     bool removePeer(int64_t from_pid);
-    bool sendToRoom(int64_t from_pid, const std::string& msg);
+    // 房间为空时关闭它, 之后addPeer都会失败. 返回true表示调用方负责删除房间
+    bool closeIfEmpty();
+    bool sendToRoom(int64_t from_pid, std::string_view msg);
     bool isInroom(int64_t from_pid);
     bool empty();
 
@@ -40,9 +45,14 @@ public:
                   rapidjson::Document::AllocatorType& allocator);
     int64_t getID() const { return id_; };
 
+    // 成员的快照, 广播时不用加锁
+    PeerSet::Snapshot peers() const { return peers_.snapshot(); }
+
 private:
-    std::unordered_map<int64_t, std::shared_ptr<Peer>> peers_;
+    PeerSet peers_;
     std::mutex mu_;
+    // 在mu_下修改, 关闭后房间只等着从房间表中删除
+    bool closed_;
     int64_t id_;
     Session session_;
     static log4cxx::LoggerPtr logger_;
@@ -5,6 +5,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "peer.h"
 #include "peerManager.h"
@@ -15,7 +16,7 @@ RoomManager* RoomManager::getInstance() {
     return &room_manager;
 }
 
-RoomManager::RoomManager() : next_id_(0) {}
+RoomManager::RoomManager() : rooms_(std::make_shared<const RoomMap>()) {}
 
 log4cxx::LoggerPtr RoomManager::logger_ =
     log4cxx::Logger::getLogger("processor");
@@ -38,31 +39,22 @@ void RoomManager::searchRoom(Type::connection_ptr con, int64_t rid,
 
 void RoomManager::createRoom(Type::connection_ptr con, int64_t from_pid) {
     LOG4CXX_INFO(logger_, "from_pid: " << from_pid << " want to create room");
-    std::shared_ptr<Peer> peer = PeerManager::getInstance()->getPeer(from_pid);
-    if (peer.get() == nullptr) {
-        LOG4CXX_INFO(logger_, "from_pid: " << from_pid << " not log in system");
-        response(con, "from_pid: " + std::to_string(from_pid) +
-                          " not log in system");
+    std::shared_ptr<Peer> peer = getPeerOutOfRoom(con, from_pid);
+    if (!peer)
         return;
-    }
-    int64_t cur_rid = peer->peer_status_.getRoomID();
-    if (cur_rid != -1) {
-        LOG4CXX_INFO(logger_, "from_pid: " << from_pid
-                                           << " have already joined in room: "
-                                           << cur_rid);
-        response(con, "from_pid: " + std::to_string(from_pid) +
-                          " have already joined in room: " +
-                          std::to_string(cur_rid));
+    int64_t rid = ids_.allocate();
+    if (rid < 0) {
+        LOG4CXX_ERROR(logger_, "no rid left for " << from_pid);
+        response(con, "server full, try again later");
         return;
     }
-    int64_t rid;
     {
         std::lock_guard<std::mutex> rlock(mu_);
-        while (rooms_.find(next_id_) != rooms_.end()) next_id_++;
-        rid = next_id_++;
         std::shared_ptr<Room> room = std::make_shared<Room>(rid);
         room->addPeer(from_pid, peer);
-        rooms_.emplace(rid, room);
+        std::shared_ptr<RoomMap> rooms = std::make_shared<RoomMap>(*rooms_);
+        rooms->emplace(rid, room);
+        std::atomic_store(&rooms_, Snapshot(std::move(rooms)));
     }
     LOG4CXX_INFO(logger_, "Room " << rid << " created by " << from_pid);
     response(con, "success",
@@ -73,23 +65,9 @@ void RoomManager::joinRoom(Type::connection_ptr con, int64_t rid,
                            int64_t from_pid) {
     LOG4CXX_INFO(logger_,
                  "from_pid: " << from_pid << " want to join room: " << rid);
-    std::shared_ptr<Peer> peer = PeerManager::getInstance()->getPeer(from_pid);
-    if (peer.get() == nullptr) {
-        LOG4CXX_INFO(logger_, "from_pid: " << from_pid << " not log in system");
-        response(con, "from_pid: " + std::to_string(from_pid) +
-                          " not log in system");
+    std::shared_ptr<Peer> peer = getPeerOutOfRoom(con, from_pid);
+    if (!peer)
         return;
-    }
-    int64_t cur_rid = peer->peer_status_.getRoomID();
-    if (cur_rid != -1) {
-        LOG4CXX_INFO(logger_, "from_pid: " << from_pid
-                                           << " have already joined in room: "
-                                           << cur_rid);
-        response(con, "from_pid: " + std::to_string(from_pid) +
-                          " have already joined in room: " +
-                          std::to_string(cur_rid));
-        return;
-    }
     std::shared_ptr<Room> room = getRoom(rid);
     if (room && room->addPeer(from_pid, peer)) {
         response(con, "success",
@@ -98,6 +76,62 @@ void RoomManager::joinRoom(Type::connection_ptr con, int64_t rid,
         response(con, "room not exist!");
 }
 
+void RoomManager::joinCall(Type::connection_ptr con, int64_t rid,
+                           int64_t from_pid, const std::string_view *name,
+                           bool join_session) {
+    LOG4CXX_INFO(logger_, "from_pid: " << from_pid
+                                       << " want to join call in room: " << rid
+                                       << ", session: " << join_session);
+    std::shared_ptr<Room> room = getRoom(rid);
+    if (!room) {
+        LOG4CXX_INFO(logger_, "room not exist, rid: " << rid);
+        response(con, "room not exist!");
+        return;
+    }
+    PeerManager* peer_manager = PeerManager::getInstance();
+    std::shared_ptr<Peer> peer;
+    if (name) {
+        if (!(peer = peer_manager->addPeer(con, from_pid, *name))) {
+            response(con, "server full, try again later");
+            return;
+        }
+    } else if (!(peer = getPeerOutOfRoom(con, from_pid))) {
+        return;
+    }
+    int64_t pid = peer->id();
+    if (!room->addPeer(pid, peer)) {
+        if (name)
+            peer_manager->removePeer(pid);
+        response(con, "room not exist!");
+        return;
+    }
+    if (join_session && !room->session_.joinSession(pid)) {
+        // joinSession可能在通知其他成员时才失败, 这时已经计入了会话
+        if (peer->peer_status_.isInSession())
+            room->session_.leftSession(pid);
+        room->removePeer(pid);
+        eraseIfEmpty(room);
+        if (name)
+            peer_manager->removePeer(pid);
+        response(con, "join Session failed");
+        return;
+    }
+
+    rapidjson::Document d;
+    d.SetObject();
+    d.AddMember("msg", "success", d.GetAllocator());
+    d.AddMember("type", "joinCall", d.GetAllocator());
+    d.AddMember("pid", pid, d.GetAllocator());
+    room->getPeers(d, d.GetAllocator());
+    if (join_session) {
+        rapidjson::Document status;
+        room->session_.getSessionStatus(status);
+        d.AddMember("session", rapidjson::Value(status, d.GetAllocator()),
+                    d.GetAllocator());
+    }
+    reply(con, getString(d));
+}
+
 void RoomManager::leftRoom(Type::connection_ptr con, int64_t rid,
                            int64_t from_pid) {
     LOG4CXX_INFO(logger_,
@@ -110,14 +144,65 @@ void RoomManager::leftRoom(Type::connection_ptr con, int64_t rid,
         response(con, "room not exist!");
         return;
     }
-    if (room->empty()) {
-        LOG4CXX_INFO(logger_, "erase empty room: " << room->getID());
-        rooms_.erase(room->getID());
+    eraseIfEmpty(room);
+}
+
+void RoomManager::dropPeer(Type::connection_ptr con, int64_t pid) {
+    PeerManager* peer_manager = PeerManager::getInstance();
+    std::shared_ptr<Peer> peer = peer_manager->getPeer(pid);
+    // pid已登出或者已经被另一个连接重新登录
+    if (!peer || peer->getCon() != con)
+        return;
+    LOG4CXX_INFO(logger_, "connection of " << pid << " closed, drop it.");
+    int64_t rid = peer->peer_status_.getRoomID();
+    std::shared_ptr<Room> room = rid == -1 ? nullptr : getRoom(rid);
+    if (room) {
+        if (peer->peer_status_.isInSession())
+            room->session_.leftSession(pid);
+        room->removePeer(pid);
+        eraseIfEmpty(room);
+    }
+    peer_manager->removePeer(pid);
+}
+
+void RoomManager::eraseIfEmpty(const std::shared_ptr<Room>& room) {
+    if (!room->closeIfEmpty())
+        return;
+    LOG4CXX_INFO(logger_, "erase empty room: " << room->getID());
+    std::lock_guard<std::mutex> rlock(mu_);
+    auto r = rooms_->find(room->getID());
+    if (r != rooms_->end() && r->second == room) {
+        std::shared_ptr<RoomMap> rooms = std::make_shared<RoomMap>(*rooms_);
+        rooms->erase(room->getID());
+        std::atomic_store(&rooms_, Snapshot(std::move(rooms)));
+        ids_.release(room->getID());
+    }
+}
+
+std::shared_ptr<Peer> RoomManager::getPeerOutOfRoom(Type::connection_ptr con,
+                                                    int64_t from_pid) {
+    std::shared_ptr<Peer> peer = PeerManager::getInstance()->getPeer(from_pid);
+    if (peer.get() == nullptr) {
+        LOG4CXX_INFO(logger_, "from_pid: " << from_pid << " not log in system");
+        response(con, "from_pid: " + std::to_string(from_pid) +
+                          " not log in system");
+        return nullptr;
+    }
+    int64_t cur_rid = peer->peer_status_.getRoomID();
+    if (cur_rid != -1) {
+        LOG4CXX_INFO(logger_, "from_pid: " << from_pid
+                                           << " have already joined in room: "
+                                           << cur_rid);
+        response(con, "from_pid: " + std::to_string(from_pid) +
+                          " have already joined in room: " +
+                          std::to_string(cur_rid));
+        return nullptr;
     }
+    return peer;
 }
 
 void RoomManager::sendToRoom(Type::connection_ptr con, int64_t rid,
-                             int64_t from_pid, const std::string& msg) {
+                             int64_t from_pid, std::string_view msg) {
     LOG4CXX_INFO(logger_, "from_pid: " << from_pid
                                        << " want to send msg to room: " << rid);
     std::shared_ptr<Room> room = getRoom(rid);
@@ -142,16 +227,17 @@ void RoomManager::getPeersInRoom(Type::connection_ptr con, int64_t rid,
     d.SetObject();
     room->getPeers(d, d.GetAllocator());
     d.AddMember("msg", "success", d.GetAllocator());
-    con->send(getString(d));
+    reply(con, getString(d));
 }
 
 void RoomManager::getAllPeers(Type::connection_ptr con, int64_t from_pid) {
     LOG4CXX_INFO(logger_, "from_pid: " << from_pid << " want to get all peers");
-    std::lock_guard<std::mutex> plock(mu_);
+    // 在房间表的快照上序列化, 不挡住创建/删除房间和其他房间的查找
+    Snapshot snapshot = this->snapshot();
     rapidjson::Document d;
     d.SetObject();
     rapidjson::Value rooms(rapidjson::kArrayType);
-    for (auto& room : rooms_) {
+    for (auto& room : *snapshot) {
         rapidjson::Document room_peers;
         room_peers.SetObject();
         room.second->getPeers(room_peers, d.GetAllocator());
@@ -159,7 +245,7 @@ void RoomManager::getAllPeers(Type::connection_ptr con, int64_t from_pid) {
     }
     d.AddMember("rooms", rooms, d.GetAllocator());
     d.AddMember("msg", "success", d.GetAllocator());
-    con->send(getString(d));
+    reply(con, getString(d));
 }
 
 void RoomManager::call(Type::connection_ptr con, int64_t rid, int64_t from_pid,
@@ -274,11 +360,11 @@ void RoomManager::getSessionStatus(Type::connection_ptr con, int64_t rid) {
     rapidjson::Document d;
     room->session_.getSessionStatus(d);
     d.AddMember("msg", "success", d.GetAllocator());
-    con->send(getString(d));
+    reply(con, getString(d));
 }
 
 void RoomManager::sendToSession(Type::connection_ptr con, int64_t rid,
-                                int64_t from_pid, const std::string& msg) {
+                                int64_t from_pid, std::string_view msg) {
     LOG4CXX_INFO(
         logger_,
         "from_pid: " << from_pid
@@ -293,7 +379,7 @@ void RoomManager::sendToSession(Type::connection_ptr con, int64_t rid,
 
 void RoomManager::sendSDPOffer(Type::connection_ptr con, int64_t rid,
                                int64_t from_pid, int64_t dest_pid,
-                               const std::string& offer) {
+                               std::string_view offer) {
     LOG4CXX_INFO(logger_, "from_pid: " << from_pid
                                        << " want to send sdp offer to dest "
                                        << dest_pid);
@@ -308,7 +394,7 @@ void RoomManager::sendSDPOffer(Type::connection_ptr con, int64_t rid,
 
 void RoomManager::sendSDPAnswer(Type::connection_ptr con, int64_t rid,
                                 int64_t from_pid, int64_t dest_pid,
-                                const std::string& answer) {
+                                std::string_view answer) {
     LOG4CXX_INFO(logger_, "from_pid: " << from_pid
                                        << " want to send sdp answer to dest "
                                        << dest_pid);
@@ -323,7 +409,7 @@ void RoomManager::sendSDPAnswer(Type::connection_ptr con, int64_t rid,
 
 void RoomManager::sendICECandidate(Type::connection_ptr con, int64_t rid,
                                    int64_t from_pid, int64_t dest_pid,
-                                   const std::string& candidate) {
+                                   std::string_view candidate) {
     LOG4CXX_INFO(logger_, "from_pid: " << from_pid
                                        << " want to send ICECandidate to dest "
                                        << dest_pid);
@@ -337,6 +423,40 @@ void RoomManager::sendICECandidate(Type::connection_ptr con, int64_t rid,
         response(con, "sendICECandidate failed");
 }
 
+void RoomManager::multicastSDPOffer(Type::connection_ptr con, int64_t rid,
+                                    int64_t from_pid,
+                                    const std::vector<int64_t> &dest_pids,
+                                    std::string_view offer) {
+    LOG4CXX_INFO(logger_, "from_pid: " << from_pid
+                                       << " want to multicast SDPOffer to "
+                                       << dest_pids.size() << " dests");
+    std::shared_ptr<Room> room = getRoom(rid);
+    size_t sent = 0;
+    if (room &&
+        room->session_.multicastSDPOffer(from_pid, dest_pids, offer, &sent)) {
+        response(con, "success",
+                 {"type", "multicastSDPOffer", "sent", std::to_string(sent)});
+    } else
+        response(con, "multicastSDPOffer failed");
+}
+
+void RoomManager::multicastICECandidate(Type::connection_ptr con, int64_t rid,
+                                        int64_t from_pid,
+                                        const std::vector<int64_t> &dest_pids,
+                                        std::string_view candidate) {
+    LOG4CXX_INFO(logger_, "from_pid: " << from_pid
+                                       << " want to multicast ICECandidate to "
+                                       << dest_pids.size() << " dests");
+    std::shared_ptr<Room> room = getRoom(rid);
+    size_t sent = 0;
+    if (room && room->session_.multicastICECandidate(from_pid, dest_pids,
+                                                     candidate, &sent)) {
+        response(con, "success", {"type", "multicastICECandidate", "sent",
+                                  std::to_string(sent)});
+    } else
+        response(con, "multicastICECandidate failed");
+}
+
 void RoomManager::connected(Type::connection_ptr con, int64_t rid,
                             int64_t from_pid) {
     LOG4CXX_INFO(logger_,
@@ -435,9 +555,7 @@ void RoomManager::closeAudio(Type::connection_ptr con, int64_t rid,
 }
 
 std::shared_ptr<Room> RoomManager::getRoom(int64_t rid) {
-    std::lock_guard<std::mutex> plock(mu_);
-    if (rooms_.find(rid) != rooms_.end()) {
-        return rooms_.at(rid);
-    }
-    return {};
+    Snapshot rooms = snapshot();
+    auto room = rooms->find(rid);
+    return room == rooms->end() ? std::shared_ptr<Room>() : room->second;
 }
@@ -1,9 +1,13 @@
 #ifndef _ROOMMANAGER_H_
 #define _ROOMMANAGER_H_
 
+#include <memory>
 #include <mutex>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
+#include "idAllocator.h"
 #include "room.h"
 #include "session.h"
 #include "type.h"
@@ -18,12 +22,19 @@ public:
     void createRoom(Type::connection_ptr con, int64_t from_pid);
     void joinRoom(Type::connection_ptr con, int64_t rid, int64_t from_pid);
     void leftRoom(Type::connection_ptr con, int64_t rid, int64_t from_pid);
+    // 连接断开时清理这个连接上登录的pid: 和客户端依次离开会话、离开房间、
+    // 登出一样, 通知房间里的其他成员, 但不回复
+    void dropPeer(Type::connection_ptr con, int64_t pid);
     // 给room发消息除了from_pid
     void sendToRoom(Type::connection_ptr con, int64_t rid, int64_t from_pid,
-                    const std::string& msg);
+                    std::string_view msg);
     void getAllPeers(Type::connection_ptr con, int64_t from_pid);
     void getPeersInRoom(Type::connection_ptr con, int64_t rid,
                         int64_t from_pid);
+    // 组合操作: name非空时先登录, 再加入房间, join_session时再加入会话,
+    // 一次回复pid、房间成员和会话状态. 任何一步失败都撤销前面的步骤
+    void joinCall(Type::connection_ptr con, int64_t rid, int64_t from_pid,
+                  const std::string_view *name, bool join_session);
 
     // 会话接口
     void call(Type::connection_ptr con, int64_t rid, int64_t from_pid,
@@ -46,18 +57,28 @@ public:
     void getSessionStatus(Type::connection_ptr con, int64_t rid);
 
     void sendToSession(Type::connection_ptr con, int64_t rid, int64_t from_pid,
-                       const std::string& msg);
+                       std::string_view msg);
 
     // 会话协商
     // todo:现在是发给个人的，muc架构应该是发给turn的
+    // offer/answer/candidate是原始的json字符串, 带引号和转义
     void sendSDPOffer(Type::connection_ptr con, int64_t rid, int64_t from_pid,
-                      int64_t dest_pid, const std::string& offer);
+                      int64_t dest_pid, std::string_view offer);
 
     void sendSDPAnswer(Type::connection_ptr con, int64_t rid, int64_t from_pid,
-                       int64_t dest_pid, const std::string& answer);
+                       int64_t dest_pid, std::string_view answer);
     void sendICECandidate(Type::connection_ptr con, int64_t rid,
                           int64_t from_pid, int64_t dest_pid,
-                          const std::string& candidate);
+                          std::string_view candidate);
+    // dest_pids为空时发给除from_pid外的所有会话成员
+    void multicastSDPOffer(Type::connection_ptr con, int64_t rid,
+                           int64_t from_pid,
+                           const std::vector<int64_t> &dest_pids,
+                           std::string_view offer);
+    void multicastICECandidate(Type::connection_ptr con, int64_t rid,
+                               int64_t from_pid,
+                               const std::vector<int64_t> &dest_pids,
+                               std::string_view candidate);
     void connected(Type::connection_ptr con, int64_t rid, int64_t from_pid);
 
     // 会话中控制
@@ -70,15 +91,28 @@ public:
     void openAudio(Type::connection_ptr con, int64_t rid, int64_t from_pid);
     void closeAudio(Type::connection_ptr con, int64_t rid, int64_t from_pid);
 
+    std::shared_ptr<Room> getRoom(int64_t rid);
+
 private:
     static log4cxx::LoggerPtr logger_;
     RoomManager();
+    // 已登录且不在任何房间的peer, 否则回复错误并返回nullptr
+    std::shared_ptr<Peer> getPeerOutOfRoom(Type::connection_ptr con,
+                                           int64_t from_pid);
+    // 房间空了就关闭并从房间表中删除, 回收rid
+    void eraseIfEmpty(const std::shared_ptr<Room>& room);
 
-    std::shared_ptr<Room> getRoom(int64_t rid);
+    typedef std::unordered_map<int64_t, std::shared_ptr<Room>> RoomMap;
+    typedef std::shared_ptr<const RoomMap> Snapshot;
+
+    // 房间表是copy-on-write的: 读者atomic_load拿到不可变的快照, 不加锁;
+    // 创建和删除房间时在mu_下复制一份新表整体替换
+    Snapshot snapshot() const { return std::atomic_load(&rooms_); }
 
-    std::unordered_map<int64_t, std::shared_ptr<Room>> rooms_;
+    Snapshot rooms_;
+    // 只用来串行化写者
     std::mutex mu_;
-    int64_t next_id_;
+    IdAllocator ids_;
 };
 
 #endif  // _ROOMMANAGER_H_
\ No newline at end of file
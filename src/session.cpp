@@ -1,12 +1,13 @@
 #include "session.h"
 
+#include <ctime>
+
 #include "sessionDumper.h"
 #include "util.h"
 
 log4cxx::LoggerPtr Session::logger_ = log4cxx::Logger::getLogger("processor");
 
-Session::Session(std::unordered_map<int64_t, std::shared_ptr<Peer>> *peers,
-                 std::mutex *mu, int64_t room_id)
+Session::Session(PeerSet *peers, std::mutex *mu, int64_t room_id)
     : peers_(peers),
       mu_(mu),
       id_(room_id),
@@ -17,6 +18,7 @@ Session::Session(std::unordered_map<int64_t, std::shared_ptr<Peer>> *peers,
 Session &Session::operator=(const Session &other) {
     this->peers_ = other.peers_;
     this->mu_ = other.mu_;
+    this->members_ = other.members_;
     this->id_ = other.id_;
     this->count_.store(other.count_.load());
     this->start_time_ = other.start_time_;
@@ -50,13 +52,18 @@ bool Session::callAccept(int64_t from_pid, int64_t dest_pid) {
                                                << ", room id: " << id_);
         return false;
     }
-    from->peer_status_.setIsInSession(true);
-    dest->peer_status_.setIsInSession(true);
-    std::string now = nowTime();
-    from->peer_status_.join_time_ = now;
-    dest->peer_status_.join_time_ = now;
-    if (count_.fetch_add(2) == 0) {
-        start_time_ = now;
+    {
+        std::lock_guard<std::mutex> lock(*mu_);
+        from->peer_status_.setIsInSession(true);
+        dest->peer_status_.setIsInSession(true);
+        members_.add(from_pid, from);
+        members_.add(dest_pid, dest);
+        int64_t now = std::time(nullptr);
+        from->peer_status_.setJoinTime(now);
+        dest->peer_status_.setJoinTime(now);
+        if (count_.fetch_add(2) == 0) {
+            start_time_ = formatTime(now);
+        }
     }
     return this->sendSignal(from, dest, "callAccept");
 }
@@ -93,11 +100,15 @@ bool Session::inviteAccept(int64_t from_pid, int64_t dest_pid) {
                                                         << dest_pid);
         return false;
     }
-    from->peer_status_.setIsInSession(true);
-    std::string now = nowTime();
-    from->peer_status_.join_time_ = now;
-    if (count_.fetch_add(1) == 0) {
-        start_time_ = now;
+    {
+        std::lock_guard<std::mutex> lock(*mu_);
+        from->peer_status_.setIsInSession(true);
+        members_.add(from_pid, from);
+        int64_t now = std::time(nullptr);
+        from->peer_status_.setJoinTime(now);
+        if (count_.fetch_add(1) == 0) {
+            start_time_ = formatTime(now);
+        }
     }
     return this->sendSignal(from, dest, "inviteAccept") &&
            this->sendSignal(from, "joinSession");
@@ -120,12 +131,16 @@ bool Session::joinSession(int64_t from_pid) {
         LOG4CXX_WARN(logger_, "not in room peer id: " << from_pid);
         return false;
     }
-    std::string now = nowTime();
-    from->peer_status_.join_time_ = now;
-    if (count_.fetch_add(1) == 0) {
-        start_time_ = now;
+    {
+        std::lock_guard<std::mutex> lock(*mu_);
+        int64_t now = std::time(nullptr);
+        from->peer_status_.setJoinTime(now);
+        if (count_.fetch_add(1) == 0) {
+            start_time_ = formatTime(now);
+        }
+        from->peer_status_.setIsInSession(true);
+        members_.add(from_pid, from);
     }
-    from->peer_status_.setIsInSession(true);
     return this->sendSignal(from, "joinSession");
 }
 
@@ -135,13 +150,14 @@ bool Session::leftSession(int64_t from_pid) {
         LOG4CXX_WARN(logger_, "failed to get peer id: " << from_pid);
         return false;
     }
+    // 会话的计数和时间只在房间锁内修改, 锁内不发送消息
+    std::lock_guard<std::mutex> lock(*mu_);
     from->peer_status_.setIsInSession(false);
-    LOG4CXX_DEBUG(logger_, "join time" << from->peer_status_.join_time_);
-    std::string now = nowTime();
-    from->peer_status_.left_time_ = now;
+    members_.remove(from_pid);
+    LOG4CXX_DEBUG(logger_, "join time" << from->peer_status_.joinTime());
+    from->peer_status_.setLeftTime(std::time(nullptr));
     // todo: here send to sql and reset.
     if (count_.fetch_sub(1) == 1) {
-        std::lock_guard<std::mutex> lock(*mu_);
         LOG4CXX_INFO(logger_, "all user left session, will dump");
         end_time_ = nowTime();
         auto dumper = SessionDumper::getInstance();
@@ -149,7 +165,7 @@ bool Session::leftSession(int64_t from_pid) {
         log.room_id_ = id_;
         log.start_time_ = start_time_;
         log.end_time_ = end_time_;
-        for (auto &p : *peers_) {
+        for (auto &p : *peers_->snapshot()) {
             if (p.second->peer_status_.wasInSession()) {
                 log.peers.push_back(
                     {p.second->id(), p.second->name(), p.second->ip()});
@@ -160,89 +176,86 @@ bool Session::leftSession(int64_t from_pid) {
             end_time_.clear();
         }
         dumper->addSessionLog(log);
+        members_.clear();
     }
     return true;
 }
 
+void Session::removeMember(int64_t pid) { members_.remove(pid); }
+
 void Session::getSessionStatus(rapidjson::Document &d) {
-    std::lock_guard<std::mutex> lock(*mu_);
+    static const struct {
+        const char *key;
+        PeerStatus::Flag flag;
+    } kFlags[] = {
+        {"AudioUsed", PeerStatus::AUDIO_USED},
+        {"AudioUsing", PeerStatus::AUDIO_USING},
+        {"CameraUsed", PeerStatus::CAMERA_USED},
+        {"CameraUsing", PeerStatus::CAMERA_USING},
+        {"ScreenUsed", PeerStatus::SCREEN_USED},
+        {"ScreenUsing", PeerStatus::SCREEN_USING},
+        {"SendOffer", PeerStatus::SEND_OFFER},
+        {"ReceiveOffer", PeerStatus::RECEIVE_OFFER},
+        {"SendAnswer", PeerStatus::SEND_ANSWER},
+        {"ReceiveAnswer", PeerStatus::RECEIVE_ANSWER},
+        {"SendCandidate", PeerStatus::SEND_CANDIDATE},
+        {"ReceiveCandidate", PeerStatus::RECEIVE_CANDIDATE},
+        {"Connected", PeerStatus::CONNECTED},
+    };
     d.SetObject();
-    d.AddMember("rid", id_, d.GetAllocator());
+    rapidjson::Document::AllocatorType &allocator = d.GetAllocator();
+    d.AddMember("rid", id_, allocator);
     rapidjson::Value statuses(rapidjson::kArrayType);
-    for (auto &p : *peers_) {
-        if (p.second->peer_status_.isInSession()) {
-            auto &ps = p.second->peer_status_;
-            rapidjson::Document status;  // Null
-            status.SetObject();
-            status.AddMember("pid", p.first, status.GetAllocator());
-            status.AddMember("name",
-                             rapidjson::Value(p.second->name().c_str(),
-                                              status.GetAllocator()),
-                             status.GetAllocator());
-            status.AddMember(
-                "ip",
-                rapidjson::Value(p.second->ip().c_str(), status.GetAllocator()),
-                status.GetAllocator());
-            status.AddMember("AudioUsed", ps.isAudioUsed(),
-                             status.GetAllocator());
-            status.AddMember("AudioUsing", ps.isAudioUsing(),
-                             status.GetAllocator());
-            status.AddMember("CameraUsed", ps.isCameraUsed(),
-                             status.GetAllocator());
-            status.AddMember("CameraUsing", ps.isCameraUsing(),
-                             status.GetAllocator());
-            status.AddMember("ScreenUsed", ps.isScreenUsed(),
-                             status.GetAllocator());
-            status.AddMember("ScreenUsing", ps.isScreenUsing(),
-                             status.GetAllocator());
-            status.AddMember("SendOffer", ps.isSendOffer(),
-                             status.GetAllocator());
-            status.AddMember("ReceiveOffer", ps.isReceiveOffer(),
-                             status.GetAllocator());
-            status.AddMember("SendAnswer", ps.isSendAnswer(),
-                             status.GetAllocator());
-            status.AddMember("ReceiveAnswer", ps.isReceiveAnswer(),
-                             status.GetAllocator());
-            status.AddMember("SendCandidate", ps.isSendCandidate(),
-                             status.GetAllocator());
-            status.AddMember("ReceiveCandidate", ps.isReceiveCandidate(),
-                             status.GetAllocator());
-            status.AddMember("Connected", ps.isConnected(),
-                             status.GetAllocator());
-            statuses.PushBack(status, d.GetAllocator());
+    for (auto &p : *members_.snapshot()) {
+        // 一次load拿到一致的状态
+        uint32_t flags = p.second->peer_status_.flags();
+        rapidjson::Value status(rapidjson::kObjectType);
+        status.AddMember("pid", p.first, allocator);
+        status.AddMember(
+            "name", rapidjson::Value(p.second->name().c_str(), allocator),
+            allocator);
+        status.AddMember(
+            "ip", rapidjson::Value(p.second->ip().c_str(), allocator),
+            allocator);
+        for (auto &f : kFlags) {
+            status.AddMember(rapidjson::StringRef(f.key),
+                             PeerStatus::has(flags, f.flag), allocator);
         }
+        statuses.PushBack(status, allocator);
     }
-    d.AddMember("statuses", statuses, d.GetAllocator());
+    d.AddMember("statuses", statuses, allocator);
 }
 
-bool Session::sendToSession(int64_t from_pid, const std::string &msg) {
-    std::lock_guard<std::mutex> lock(*mu_);
-    if (peers_->find(from_pid) == peers_->end() ||
-        !(*peers_)[from_pid]->peer_status_.isInSession()) {
+bool Session::sendToSession(int64_t from_pid, std::string_view msg) {
+    rapidjson::Document d;
+    d.SetObject();
+    d.AddMember("type", "text", d.GetAllocator());
+    d.AddMember("from", "session", d.GetAllocator());
+    d.AddMember("from_pid", from_pid, d.GetAllocator());
+    d.AddMember("msg", "text", d.GetAllocator());
+    d.AddMember("text", rapidjson::Value(jsonRef(msg)), d.GetAllocator());
+
+    // 只发给会话成员, 在快照上发送, 不持有房间锁
+    PeerSet::Snapshot peers = members_.snapshot();
+    auto from = peers->find(from_pid);
+    if (from == peers->end()) {
         LOG4CXX_WARN(logger_, "pid: " << from_pid << " not in session " << id_
                                       << ", can not send msg to session.");
         return false;
     }
-    int len = peers_->size();
-    for (auto p = peers_->begin(); p != peers_->end();) {
+    // 只序列化一次, 所有成员共用同一个只读的消息
+    Type::message_ptr message =
+        makeMessage(from->second->getCon(), d, msg.size() + 128);
+    for (auto &p : *peers) {
         try {
-            rapidjson::Document d;
-            d.SetObject();
-            d.AddMember("type", "text", d.GetAllocator());
-            d.AddMember("from", "session", d.GetAllocator());
-            d.AddMember("from_pid", from_pid, d.GetAllocator());
-            d.AddMember("msg", "text", d.GetAllocator());
-            d.AddMember("text", rapidjson::Value(msg.c_str(), d.GetAllocator()),
-                        d.GetAllocator());
-            p->second->sendMsg(getString(d));
+            p.second->sendMsg(message, OutboundQueue::CHAT);
         } catch (std::exception const &e) {
             LOG4CXX_ERROR(logger_, e.what());
             LOG4CXX_ERROR(logger_, "failed to send msg to pid "
-                                       << p->first << "in room " << id_);
-            p = peers_->erase(p);
-            continue;
+                                       << p.first << "in room " << id_);
+            peers_->remove(p.first);
+            members_.remove(p.first);
         }
-        ++p;
     }
     return true;
 }
@@ -264,7 +277,7 @@ bool Session::openCamera(int64_t from_pid) {
         return false;
     }
     from->peer_status_.setCameraUsing(true);
-    return this->sendSignal(from, "openCamera");
+    return this->sendSignal(from, "openCamera", {}, "camera");
 }
 
 bool Session::closeCamera(int64_t from_pid) {
@@ -274,7 +287,7 @@ bool Session::closeCamera(int64_t from_pid) {
         return false;
     }
     from->peer_status_.setCameraUsing(false);
-    return this->sendSignal(from, "closeCamera");
+    return this->sendSignal(from, "closeCamera", {}, "camera");
 }
 
 bool Session::openScreen(int64_t from_pid) {
@@ -284,7 +297,7 @@ bool Session::openScreen(int64_t from_pid) {
         return false;
     }
     from->peer_status_.setScreenUsing(true);
-    return this->sendSignal(from, "openScreen");
+    return this->sendSignal(from, "openScreen", {}, "screen");
 }
 
 bool Session::closeScreen(int64_t from_pid) {
@@ -294,7 +307,7 @@ bool Session::closeScreen(int64_t from_pid) {
         return false;
     }
     from->peer_status_.setScreenUsing(false);
-    return this->sendSignal(from, "closeScreen");
+    return this->sendSignal(from, "closeScreen", {}, "screen");
 }
 
 bool Session::openAudio(int64_t from_pid) {
@@ -304,7 +317,7 @@ bool Session::openAudio(int64_t from_pid) {
         return false;
     }
     from->peer_status_.setAudioUsing(true);
-    return this->sendSignal(from, "openAudio");
+    return this->sendSignal(from, "openAudio", {}, "audio");
 }
 
 bool Session::closeAudio(int64_t from_pid) {
@@ -314,12 +327,12 @@ bool Session::closeAudio(int64_t from_pid) {
         return false;
     }
     from->peer_status_.setAudioUsing(false);
-    return this->sendSignal(from, "closeAudio");
+    return this->sendSignal(from, "closeAudio", {}, "audio");
 }
 
 // 会话协商
 bool Session::sendSDPOffer(int64_t from_pid, int64_t dest_pid,
-                           const std::string &offer) {
+                           std::string_view offer) {
     std::shared_ptr<Peer> from;
     std::shared_ptr<Peer> dest;
     if (!(from = getPeer(from_pid)) || !(dest = getPeer(dest_pid))) {
@@ -328,7 +341,7 @@ bool Session::sendSDPOffer(int64_t from_pid, int64_t dest_pid,
         return false;
     }
 
-    if (this->sendSignal(from, dest, "SDPOffer", {"offer", offer})) {
+    if (this->sendRawSignal(from, dest, "SDPOffer", "offer", offer)) {
         from->peer_status_.setSendOffer(true);
         dest->peer_status_.setReceiveOffer(true);
         return true;
@@ -337,7 +350,7 @@ bool Session::sendSDPOffer(int64_t from_pid, int64_t dest_pid,
 }
 
 bool Session::sendSDPAnswer(int64_t from_pid, int64_t dest_pid,
-                            const std::string &answer) {
+                            std::string_view answer) {
     std::shared_ptr<Peer> from;
     std::shared_ptr<Peer> dest;
     if (!(from = getPeer(from_pid)) || !(dest = getPeer(dest_pid))) {
@@ -346,7 +359,7 @@ bool Session::sendSDPAnswer(int64_t from_pid, int64_t dest_pid,
         return false;
     }
 
-    if (this->sendSignal(from, dest, "SDPAnswer", {"answer", answer})) {
+    if (this->sendRawSignal(from, dest, "SDPAnswer", "answer", answer)) {
         from->peer_status_.setSendAnswer(true);
         dest->peer_status_.setReceiveAnswer(true);
         return true;
@@ -354,7 +367,7 @@ bool Session::sendSDPAnswer(int64_t from_pid, int64_t dest_pid,
     return false;
 }
 bool Session::sendICECandidate(int64_t from_pid, int64_t dest_pid,
-                               const std::string &candidate) {
+                               std::string_view candidate) {
     std::shared_ptr<Peer> from;
     std::shared_ptr<Peer> dest;
     if (!(from = getPeer(from_pid)) || !(dest = getPeer(dest_pid))) {
@@ -363,8 +376,7 @@ bool Session::sendICECandidate(int64_t from_pid, int64_t dest_pid,
         return false;
     }
 
-    if (this->sendSignal(from, dest, "ICECandidate",
-                         {"candidate", candidate})) {
+    if (this->sendRawSignal(from, dest, "ICECandidate", "candidate", candidate)) {
         from->peer_status_.setSendCandidate(true);
         dest->peer_status_.setReceiveCandidate(true);
         return true;
@@ -372,66 +384,180 @@ bool Session::sendICECandidate(int64_t from_pid, int64_t dest_pid,
     return false;
 }
 
-std::shared_ptr<Peer> Session::getPeer(int64_t pid) {
-    std::lock_guard<std::mutex> lock(*mu_);
-    if (peers_->find(pid) != peers_->end()) {
-        return peers_->at(pid);
+bool Session::multicastSDPOffer(int64_t from_pid,
+                                const std::vector<int64_t> &dest_pids,
+                                std::string_view offer, size_t *sent) {
+    std::shared_ptr<Peer> from;
+    if (!(from = getPeer(from_pid))) {
+        LOG4CXX_WARN(logger_, "failed to get peer id: " << from_pid);
+        return false;
+    }
+    std::vector<std::shared_ptr<Peer>> dests =
+        multicastRawSignal(from, dest_pids, "SDPOffer", "offer", offer);
+    from->peer_status_.setSendOffer(true);
+    for (auto &dest : dests) {
+        dest->peer_status_.setReceiveOffer(true);
+    }
+    *sent = dests.size();
+    return true;
+}
+
+bool Session::multicastICECandidate(int64_t from_pid,
+                                    const std::vector<int64_t> &dest_pids,
+                                    std::string_view candidate, size_t *sent) {
+    std::shared_ptr<Peer> from;
+    if (!(from = getPeer(from_pid))) {
+        LOG4CXX_WARN(logger_, "failed to get peer id: " << from_pid);
+        return false;
+    }
+    std::vector<std::shared_ptr<Peer>> dests = multicastRawSignal(
+        from, dest_pids, "ICECandidate", "candidate", candidate);
+    from->peer_status_.setSendCandidate(true);
+    for (auto &dest : dests) {
+        dest->peer_status_.setReceiveCandidate(true);
     }
-    return {};
+    *sent = dests.size();
+    return true;
+}
+
+std::shared_ptr<Peer> Session::getPeer(int64_t pid) {
+    return peers_->find(pid);
 }
 
 bool Session::sendSignal(std::shared_ptr<Peer> &from,
                          std::shared_ptr<Peer> &dest, const std::string &type,
-                         const std::vector<std::string> &kvs) {
+                         const std::vector<std::string_view> &kvs) {
     rapidjson::Document d;  // Null
     d.SetObject();
-    d.AddMember("type", rapidjson::Value(type.c_str(), d.GetAllocator()),
-                d.GetAllocator());
+    d.AddMember("type", rapidjson::Value(jsonRef(type)), d.GetAllocator());
     d.AddMember("msg", "signaling", d.GetAllocator());
     d.AddMember("from_pid", from->id(), d.GetAllocator());
     for (int i = 1; i < kvs.size(); i += 2) {
-        d.AddMember(rapidjson::Value(kvs[i - 1].c_str(), d.GetAllocator()),
-                    rapidjson::Value(kvs[i].c_str(), d.GetAllocator()),
-                    d.GetAllocator());
+        d.AddMember(rapidjson::Value(jsonRef(kvs[i - 1])),
+                    rapidjson::Value(jsonRef(kvs[i])), d.GetAllocator());
+    }
+    size_t reserve = 128;
+    for (auto &kv : kvs) {
+        reserve += kv.size();
     }
     try {
-        dest->sendMsg(getString(d));
+        dest->sendMsg(d, OutboundQueue::SIGNALING, reserve);
     } catch (std::exception const &e) {
         LOG4CXX_ERROR(logger_,
                       "erase pid: " << from->id() << ", because " << e.what());
-        std::lock_guard<std::mutex> lock(*mu_);
-        peers_->erase(dest->id());
+        peers_->remove(dest->id());
+        members_.remove(dest->id());
+    }
+    return true;
+}
+
+Type::message_ptr Session::makeRawSignal(const Type::connection_ptr &con,
+                                         int64_t from_pid, const char *type,
+                                         const char *key,
+                                         std::string_view raw) {
+    Type::message_ptr msg =
+        con->get_message(Type::opcode::TEXT, raw.size() + 96);
+    std::string &out = msg->get_payload();
+    out.append("{\"type\":\"").append(type);
+    out.append("\",\"msg\":\"signaling\",\"from_pid\":")
+        .append(std::to_string(from_pid));
+    out.append(",\"").append(key).append("\":").append(raw).append("}");
+    return msg;
+}
+
+bool Session::sendRawSignal(std::shared_ptr<Peer> &from,
+                            std::shared_ptr<Peer> &dest, const char *type,
+                            const char *key, std::string_view raw) {
+    try {
+        dest->sendMsg(makeRawSignal(dest->getCon(), from->id(), type, key, raw),
+                      OutboundQueue::SIGNALING);
+    } catch (std::exception const &e) {
+        LOG4CXX_ERROR(logger_,
+                      "erase pid: " << from->id() << ", because " << e.what());
+        peers_->remove(dest->id());
+        members_.remove(dest->id());
     }
     return true;
 }
 
+std::vector<std::shared_ptr<Peer>> Session::multicastRawSignal(
+    std::shared_ptr<Peer> &from, const std::vector<int64_t> &dest_pids,
+    const char *type, const char *key, std::string_view raw) {
+    std::vector<std::shared_ptr<Peer>> dests;
+    if (dest_pids.empty()) {
+        for (auto &p : *members_.snapshot()) {
+            if (p.first != from->id())
+                dests.push_back(p.second);
+        }
+    } else {
+        // dest_pids只在发起者所在的房间里查找, 重复和不存在的直接跳过
+        PeerSet::Snapshot peers = peers_->snapshot();
+        for (int64_t pid : dest_pids) {
+            auto it = peers->find(pid);
+            if (it == peers->end() || pid == from->id()) {
+                LOG4CXX_WARN(logger_, "skip multicast dest pid: " << pid);
+                continue;
+            }
+            bool dup = false;
+            for (auto &dest : dests) {
+                dup = dup || dest->id() == pid;
+            }
+            if (!dup)
+                dests.push_back(it->second);
+        }
+    }
+    if (dests.empty())
+        return dests;
+
+    // 只拼一次, 所有接收者共用同一个只读的消息
+    Type::message_ptr msg =
+        makeRawSignal(from->getCon(), from->id(), type, key, raw);
+
+    std::vector<std::shared_ptr<Peer>> sent;
+    sent.reserve(dests.size());
+    for (auto &dest : dests) {
+        try {
+            dest->sendMsg(msg, OutboundQueue::SIGNALING);
+            sent.push_back(dest);
+        } catch (std::exception const &e) {
+            LOG4CXX_ERROR(logger_, "erase pid: " << dest->id() << ", because "
+                                                 << e.what());
+            peers_->remove(dest->id());
+            members_.remove(dest->id());
+        }
+    }
+    return sent;
+}
+
 bool Session::sendSignal(std::shared_ptr<Peer> &peer, const std::string &type,
-                         const std::vector<std::string> &kvs) {
+                         const std::vector<std::string_view> &kvs,
+                         const char *coalesce) {
     rapidjson::Document d;  // Null
     d.SetObject();
-    d.AddMember("type", rapidjson::Value(type.c_str(), d.GetAllocator()),
-                d.GetAllocator());
+    d.AddMember("type", rapidjson::Value(jsonRef(type)), d.GetAllocator());
     d.AddMember("msg", "signaling", d.GetAllocator());
     d.AddMember("from_pid", peer->id(), d.GetAllocator());
     for (int i = 1; i < kvs.size(); i += 2) {
-        d.AddMember(rapidjson::Value(kvs[i - 1].c_str(), d.GetAllocator()),
-                    rapidjson::Value(kvs[i].c_str(), d.GetAllocator()),
-                    d.GetAllocator());
-    }
-    std::lock_guard<std::mutex> lock(*mu_);
-    for (auto p = peers_->begin(); p != peers_->end();) {
-        if (p->second->peer_status_.isInSession() && p->first != peer->id()) {
+        d.AddMember(rapidjson::Value(jsonRef(kvs[i - 1])),
+                    rapidjson::Value(jsonRef(kvs[i])), d.GetAllocator());
+    }
+    // 只序列化一次, 所有成员共用同一个只读的消息
+    Type::message_ptr message = makeMessage(peer->getCon(), d);
+    std::string key;
+    if (coalesce)
+        key = std::string(coalesce) + ":" + std::to_string(peer->id());
+    for (auto &p : *members_.snapshot()) {
+        if (p.first != peer->id()) {
             try {
-                p->second->sendMsg(getString(d));
+                p.second->sendMsg(message, OutboundQueue::STATE, key);
             } catch (std::exception const &e) {
-                LOG4CXX_ERROR(logger_, "erase pid: " << p->second->id()
+                LOG4CXX_ERROR(logger_, "erase pid: " << p.second->id()
                                                      << ", because "
                                                      << e.what());
-                p = peers_->erase(p);
-                continue;
+                peers_->remove(p.first);
+                members_.remove(p.first);
             }
         }
-        ++p;
     }
 
     return true;
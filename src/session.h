@@ -3,20 +3,23 @@
 
 #include <memory>
 #include <mutex>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 #include <atomic>
 
 #include "log4cxx/log4cxx.h"
 #include "log4cxx/logger.h"
 #include "peer.h"
+#include "peerSet.h"
 #include "rapidjson/document.h"
 #include "sessionInterface.h"
 
 class Session : public SessionNegotiate, public SessionControl {
 public:
     Session() = delete;
-    Session(std::unordered_map<int64_t, std::shared_ptr<Peer>> *peers,
-            std::mutex *mu, int64_t room_id);
+    // peers和mu都属于所在的Room
+    Session(PeerSet *peers, std::mutex *mu, int64_t room_id);
     Session &operator=(const Session &other);
 
     // 会话成员管理
@@ -30,19 +33,28 @@ public:
 
     bool joinSession(int64_t from_pid);
     bool leftSession(int64_t from_pid);
+    // 离开房间的peer同时从会话成员中移除
+    void removeMember(int64_t pid);
 
     void getSessionStatus(rapidjson::Document &d);
 
-    bool sendToSession(int64_t from_pid, const std::string &msg);
+    bool sendToSession(int64_t from_pid, std::string_view msg);
 
-    // 会话协商
+    // 会话协商, offer/answer/candidate是原始的json字符串(带引号和转义),
+    // 原样拼进发给对方的消息里
     bool sendSDPOffer(int64_t from_pid, int64_t dest_pid,
-                      const std::string &offer);
+                      std::string_view offer);
 
     bool sendSDPAnswer(int64_t from_pid, int64_t dest_pid,
-                       const std::string &answer);
+                       std::string_view answer);
     bool sendICECandidate(int64_t from_pid, int64_t dest_pid,
-                          const std::string &candidate);
+                          std::string_view candidate);
+    bool multicastSDPOffer(int64_t from_pid,
+                           const std::vector<int64_t> &dest_pids,
+                           std::string_view offer, size_t *sent);
+    bool multicastICECandidate(int64_t from_pid,
+                               const std::vector<int64_t> &dest_pids,
+                               std::string_view candidate, size_t *sent);
     bool connected(int64_t from_pid);
 
     // 会话控制
@@ -57,7 +69,9 @@ private:
 
     int64_t id_;
     
-    std::unordered_map<int64_t, std::shared_ptr<Peer>> *peers_;
+    PeerSet *peers_;
+    // 会话成员, 只包含正在会话中的peer, 会话内广播和状态查询只遍历它
+    PeerSet members_;
     std::mutex *mu_;
     std::atomic<int32_t> count_;
     std::string start_time_;
@@ -68,9 +82,26 @@ private:
     std::shared_ptr<Peer> getPeer(int64_t pid);
     bool sendSignal(std::shared_ptr<Peer> &from, std::shared_ptr<Peer> &dest,
                     const std::string &type,
-                    const std::vector<std::string> &kvs = {});
+                    const std::vector<std::string_view> &kvs = {});
+    // 拼出{"type":type,"msg":"signaling","from_pid":from,key:raw},
+    // raw已经是json, 不重新转义
+    static Type::message_ptr makeRawSignal(const Type::connection_ptr &con,
+                                           int64_t from_pid, const char *type,
+                                           const char *key,
+                                           std::string_view raw);
+    // 把已经是json的raw作为key字段的值拼到信令里, 不重新转义
+    bool sendRawSignal(std::shared_ptr<Peer> &from, std::shared_ptr<Peer> &dest,
+                       const char *type, const char *key,
+                       std::string_view raw);
+    // 同一条raw信令只拼一次, 发给dest_pids(为空时是其他所有会话成员),
+    // 返回实际送达的peer
+    std::vector<std::shared_ptr<Peer>> multicastRawSignal(
+        std::shared_ptr<Peer> &from, const std::vector<int64_t> &dest_pids,
+        const char *type, const char *key, std::string_view raw);
+    // coalesce非空时, 同一peer同一coalesce的状态消息在发送队列里只保留最新的
     bool sendSignal(std::shared_ptr<Peer> &peer, const std::string &type,
-                    const std::vector<std::string> &kvs = {});
+                    const std::vector<std::string_view> &kvs = {},
+                    const char *coalesce = nullptr);
 };
 
 #endif  // _SESSION_H_
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "sessionDumper.h"
 
+#include "util.h"
+
 log4cxx::LoggerPtr SessionDumper::logger_ =
     log4cxx::Logger::getLogger("server");
 
@@ -8,18 +10,24 @@ SessionDumper* SessionDumper::getInstance() {
     return &dumper;
 }
 
-SessionDumper::SessionDumper() : start_(true), t_(&SessionDumper::run, this) {
+SessionDumper::SessionDumper()
+    : input_(4096), start_(true), t_(&SessionDumper::run, this) {
     LOG4CXX_INFO(logger_, "start session dumper.");
 }
 
 SessionDumper::~SessionDumper() {
     start_ = false;
+    input_.stop();
     t_.join();
     LOG4CXX_INFO(logger_, "stop session dumper.");
 }
 
 void SessionDumper::addSessionLog(const SessionLog &l) {
-    input_.push(l);
+    if (!input_.push(l)) {
+        LOG4CXX_ERROR(logger_, "drop session log of room " << l.room_id_
+                                   << ", input capacity: " << input_.capacity()
+                                   << ", overflow: " << input_.overflow());
+    }
 }
 
 void SessionDumper::run() {
@@ -76,14 +84,19 @@ void SessionDumper::dump(SessionLog &l) {
         prep_stmt->setInt64(2, l.peers[i].id_);
         prep_stmt->setString(3, l.peers[i].name_);
         prep_stmt->setString(4, l.peers[i].ip_);
-        LOG4CXX_DEBUG(logger_, "join time"<<l.statuses[i].join_time_);
-        prep_stmt->setDateTime(5, l.statuses[i].join_time_);
-        LOG4CXX_DEBUG(logger_, "left time"<<l.statuses[i].left_time_);
-        prep_stmt->setDateTime(6, l.statuses[i].left_time_);
-        prep_stmt->setBoolean(7, l.statuses[i].isCameraUsed());
-        prep_stmt->setBoolean(8, l.statuses[i].isAudioUsed());
-        prep_stmt->setBoolean(9, l.statuses[i].isScreenUsed());
-        prep_stmt->setBoolean(10, l.statuses[i].isConnected());
+        LOG4CXX_DEBUG(logger_, "join time"<<l.statuses[i].joinTime());
+        prep_stmt->setDateTime(5, formatTime(l.statuses[i].joinTime()));
+        LOG4CXX_DEBUG(logger_, "left time"<<l.statuses[i].leftTime());
+        prep_stmt->setDateTime(6, formatTime(l.statuses[i].leftTime()));
+        uint32_t flags = l.statuses[i].flags();
+        prep_stmt->setBoolean(7,
+                              PeerStatus::has(flags, PeerStatus::CAMERA_USED));
+        prep_stmt->setBoolean(8,
+                              PeerStatus::has(flags, PeerStatus::AUDIO_USED));
+        prep_stmt->setBoolean(9,
+                              PeerStatus::has(flags, PeerStatus::SCREEN_USED));
+        prep_stmt->setBoolean(10,
+                              PeerStatus::has(flags, PeerStatus::CONNECTED));
         int rows_affected = prep_stmt->executeUpdate();
         if (rows_affected <= 0) {
             LOG4CXX_WARN(logger_,
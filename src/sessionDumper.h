@@ -7,7 +7,7 @@
 
 #include "connectionPool.h"
 #include "peerStatus.h"
-#include "producerConsumerQueue.h"
+#include "mpmcQueue.h"
 
 struct PeerInfo {
     int64_t id_;
@@ -35,9 +35,9 @@ private:
     void run();
     void dump(SessionLog &);
 
-    ProducerConsumerQueue<SessionLog> input_;
-    std::thread t_;
+    MPMCQueue<SessionLog> input_;
     std::atomic<bool> start_;
+    std::thread t_;
     static log4cxx::LoggerPtr logger_;
 };
 
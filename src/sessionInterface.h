@@ -2,16 +2,27 @@
 #define _SESSIONINTERFACE_H_
 
 #include <string>
+#include <string_view>
+#include <vector>
 
 class SessionNegotiate {
 public:
+    // offer/answer/candidate是原始的json字符串, 带引号和转义
     virtual bool sendSDPOffer(int64_t from_pid, int64_t dest_pid,
-                              const std::string& offer) = 0;
+                              std::string_view offer) = 0;
 
     virtual bool sendSDPAnswer(int64_t from_pid, int64_t dest_pid,
-                               const std::string& answer) = 0;
+                               std::string_view answer) = 0;
     virtual bool sendICECandidate(int64_t from_pid, int64_t dest_pid,
-                                  const std::string& candidate) = 0;
+                                  std::string_view candidate) = 0;
+    // dest_pids为空时发给除from_pid外的所有会话成员, sent返回实际送达的人数
+    virtual bool multicastSDPOffer(int64_t from_pid,
+                                   const std::vector<int64_t> &dest_pids,
+                                   std::string_view offer, size_t *sent) = 0;
+    virtual bool multicastICECandidate(int64_t from_pid,
+                                       const std::vector<int64_t> &dest_pids,
+                                       std::string_view candidate,
+                                       size_t *sent) = 0;
     virtual bool connected(int64_t from_pid) = 0;
 };
 
@@ -1,9 +1,12 @@
 #include "sigServer.h"
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 
 #include "log4cxx/logger.h"
+#include "operate.h"
+#include "util.h"
 #include "workerPool.h"
 
 using websocketpp::lib::bind;
@@ -12,39 +15,158 @@ using websocketpp::lib::placeholders::_2;
 
 log4cxx::LoggerPtr sigServer::logger_ = log4cxx::Logger::getLogger("server");
 
-sigServer::sigServer() : workers_() {
-    // Initialize Asio Transport
-    m_server_.init_asio();
+sigServer::sigServer(int thread_count, int shard_count,
+                     const WorkerPool::Config &workers)
+    : workers_(workers), thread_count_(thread_count < 1 ? 1 : thread_count) {
+    workers_.setRateLimiter(&limiter_);
+    if (shard_count < 1)
+        shard_count = 1;
+    if (thread_count_ < shard_count)
+        thread_count_ = shard_count;
+    for (int i = 0; i < shard_count; i++) {
+        std::unique_ptr<Type::server> server(new Type::server());
+        Type::server *s = server.get();
+        // Initialize Asio Transport, 每个shard拥有自己的io_service
+        s->init_asio();
 
-    m_server_.set_reuse_addr(true);
-    // Register handler callbacks
-    m_server_.set_message_handler(
-        bind(&sigServer::on_message, this, ::_1, ::_2));
+        s->set_reuse_addr(true);
+        if (shard_count > 1) {
+            // listen时在bind之前打开SO_REUSEPORT
+            s->set_tcp_pre_bind_handler([](Type::acceptor_ptr acceptor) {
+                typedef websocketpp::lib::asio::detail::socket_option::boolean<
+                    SOL_SOCKET, SO_REUSEPORT>
+                    reuse_port;
+                websocketpp::lib::asio::error_code ec;
+                acceptor->set_option(reuse_port(true), ec);
+                if (ec) {
+                    LOG4CXX_ERROR(logger_,
+                                  "failed to set SO_REUSEPORT: " << ec.message());
+                    return Type::error_code(ec.value(),
+                                            std::system_category());
+                }
+                return Type::error_code();
+            });
+        }
+        // Register handler callbacks
+        s->set_validate_handler(bind(&sigServer::on_validate, this, s, ::_1));
+        s->set_message_handler(
+            bind(&sigServer::on_message, this, s, ::_1, ::_2));
+        s->set_close_handler(bind(&sigServer::on_close, this, s, ::_1));
+        servers_.push_back(std::move(server));
+    }
 }
 
 void sigServer::run(uint16_t port) {
-    // listen on specified port
-    m_server_.listen(port);
+    for (auto &server : servers_) {
+        // listen on specified port
+        server->listen(port);
 
-    // Start the server accept loop
-    m_server_.start_accept();
+        // Start the server accept loop
+        server->start_accept();
+    }
 
     // Start the ASIO io_service run loop
+    // config::asio开启了multithreading, 每个连接的读写回调都在自己的strand上串行执行,
+    // 所以多个线程同时run同一个io_service是安全的
+    workers_.start();
+    int shard_count = servers_.size();
+    for (int i = 1; i < thread_count_; i++) {
+        io_threads_.push_back(std::thread(&sigServer::runLoop, this,
+                                          servers_[i % shard_count].get()));
+    }
+    LOG4CXX_INFO(logger_, "run " << shard_count << " shards on "
+                                 << thread_count_ << " threads");
+    runLoop(servers_[0].get());
+    for (auto &t : io_threads_) {
+        t.join();
+    }
+    io_threads_.clear();
+    workers_.stop();
+}
+
+void sigServer::runLoop(Type::server *server) {
     try {
-        workers_.start();
-        m_server_.run();
+        server->run();
     } catch (const std::exception &e) {
-        workers_.stop();
         LOG4CXX_FATAL(logger_, "server failed run: " << e.what());
+        for (auto &s : servers_) {
+            s->stop();
+        }
     }
 }
 
 void sigServer::on_open(Type::connection_hdl hdl) {}
 
-void sigServer::on_close(Type::connection_hdl hdl) {}
+void sigServer::on_close(Type::server *server, Type::connection_hdl hdl) {
+    Type::connection_ptr con = server->get_con_from_hdl(hdl);
+    std::shared_ptr<OutboundQueue> out = con->outbound();
+    if (out)
+        RoomManager::getInstance()->dropPeer(con, out->pid());
+}
+
+bool sigServer::on_validate(Type::server *server, Type::connection_hdl hdl) {
+    Type::connection_ptr con = server->get_con_from_hdl(hdl);
+    for (const std::string &protocol : con->get_requested_subprotocols()) {
+        if (protocol == kBatchSubprotocol) {
+            con->select_subprotocol(protocol);
+            con->batch_ = true;
+            break;
+        }
+    }
+    return true;
+}
 
-void sigServer::on_message(Type::connection_hdl hdl, Type::message_ptr msg) {
-    Type::connection_ptr con = m_server_.get_con_from_hdl(hdl);
+void sigServer::on_message(Type::server *server, Type::connection_hdl hdl,
+                           Type::message_ptr msg) {
+    Type::connection_ptr con = server->get_con_from_hdl(hdl);
     LOG4CXX_INFO(logger_, "get context");
-    workers_.addContext(Context(con, msg));
+    Context context(con, msg);
+    int64_t opt;
+    const std::string &payload = msg->get_payload();
+    size_t first = payload.find_first_not_of(" \t\r\n");
+    bool allowed = true;
+    std::vector<std::string_view> items;
+    if (first != std::string::npos && payload[first] == '[') {
+        // 批量请求: 每个操作都计入限流, 按其中最低的优先级准入和调度,
+        // 不能靠夹带一个协商操作让整批查询绕过过载保护或插队
+        if (!splitArray(payload, &items, kMaxBatchOps)) {
+            response(con, "batch must be an array of at most " +
+                              std::to_string(kMaxBatchOps) + " operations");
+            return;
+        }
+        context.batch_ = true;
+        context.lane_ = NEGOTIATION;
+        for (std::string_view item : items) {
+            int lane = peekInt64(item, "operate", &opt) ? laneOf(opt) : QUERY;
+            context.lane_ = std::max(context.lane_, lane);
+            // 有一个超限整批就会被丢弃, 之后的操作不再扣令牌
+            if (allowed)
+                allowed = limiter_.allow(con.get(), lane);
+        }
+    } else {
+        context.lane_ = peekInt64(payload, "operate", &opt) ? laneOf(opt)
+                                                            : QUERY;
+        allowed = limiter_.allow(con.get(), context.lane_);
+    }
+    // 超限的消息不进入worker队列. 和rejectBusy一样只取出req_id回复,
+    // 让客户端能结束对应的请求而不是等到超时
+    if (!allowed) {
+        uint32_t dropped = con->dropped_.load(std::memory_order_relaxed);
+        if (dropped % kDropLogEvery == 1)
+            LOG4CXX_WARN(logger_, "rate limited " << con->get_remote_endpoint()
+                                                  << ", dropped " << dropped
+                                                  << " messages, lane "
+                                                  << context.lane_);
+        if (context.batch_) {
+            for (std::string_view item : items) {
+                RequestScope scope(peekRequestId(item));
+                response(con, "rate limited");
+            }
+        } else {
+            RequestScope scope(peekRequestId(payload));
+            response(con, "rate limited");
+        }
+        return;
+    }
+    workers_.addContext(context);
 }
\ No newline at end of file
@@ -8,7 +8,10 @@
 #include <vector>
 #include "log4cxx/logger.h"
 #include <queue>
+#include <memory>
+#include <thread>
 
+#include "rateLimiter.h"
 #include "workerPool.h"
 #include "type.h"
 
@@ -17,17 +20,42 @@ class sigServer
 {
 public:
     // pull out the type of messages sent by our config
-    sigServer(/* args */);
+    // thread_count: 运行io_service的总线程数
+    // shard_count: 大于1时每个shard是独立的server和io_service,
+    //              通过SO_REUSEPORT监听同一端口, 由内核分发连接
+    // workers: worker线程数、调度方式、lane权重和准入水位
+    explicit sigServer(int thread_count = 1, int shard_count = 1,
+                       const WorkerPool::Config &workers = WorkerPool::Config());
 
     void on_open(Type::connection_hdl hdl);
-    void on_close(Type::connection_hdl hdl);
-    void on_message(Type::connection_hdl hdl, Type::message_ptr msg);
+    // 连接断开时清理连接上的peer, 包括发送队列超限被断开的连接
+    void on_close(Type::server *server, Type::connection_hdl hdl);
+    // 握手时协商可选的子协议
+    bool on_validate(Type::server *server, Type::connection_hdl hdl);
+    void on_message(Type::server *server, Type::connection_hdl hdl,
+                    Type::message_ptr msg);
 
     void run(uint16_t port);
 
+    // 在run之前调整限流参数
+    RateLimiter &limiter() { return limiter_; }
+    // 在run之前调整准入水位(setWatermarks), 其余参数在构造时通过Config给出
+    WorkerPool &workers() { return workers_; }
+
 private:
+    void runLoop(Type::server *server);
+
+    // 一个批量请求最多包含的操作数
+    static const size_t kMaxBatchOps = 64;
+    // 被限流的连接每丢弃这么多条消息打一次日志
+    static const uint32_t kDropLogEvery = 1000;
+
     WorkerPool workers_;
-    Type::server m_server_;
+    RateLimiter limiter_;
+    // 所有shard共享workers_以及PeerManager/RoomManager
+    std::vector<std::unique_ptr<Type::server>> servers_;
+    int thread_count_;
+    std::vector<std::thread> io_threads_;
     static log4cxx::LoggerPtr logger_;
 };
 
@@ -0,0 +1,33 @@
+#ifndef _TOKENBUCKET_H_
+#define _TOKENBUCKET_H_
+
+#include <atomic>
+#include <cstdint>
+
+// 无锁令牌桶, 用GCRA实现: 只记一个"理论到达时间"tat, 状态只有8字节.
+// 每消耗一个令牌tat向后推interval_us, tat超前当前时间超过tolerance_us时拒绝,
+// 等价于速率1/interval, 容量tolerance/interval+1的令牌桶
+class TokenBucket {
+public:
+    TokenBucket() : tat_us_(0) {}
+    TokenBucket(const TokenBucket &) = delete;
+    TokenBucket &operator=(const TokenBucket &) = delete;
+
+    // 消耗一个令牌, 令牌不够时返回false
+    bool consume(int64_t now_us, int64_t interval_us, int64_t tolerance_us) {
+        int64_t tat = tat_us_.load(std::memory_order_relaxed);
+        for (;;) {
+            int64_t base = tat > now_us ? tat : now_us;
+            if (base - now_us > tolerance_us)
+                return false;
+            if (tat_us_.compare_exchange_weak(tat, base + interval_us,
+                                              std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+private:
+    std::atomic<int64_t> tat_us_;
+};
+
+#endif  // _TOKENBUCKET_H_
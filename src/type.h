@@ -5,14 +5,36 @@
 #include <websocketpp/server.hpp>             // server
 #include <websocketpp/config/asio_no_tls.hpp> // websocketpp::config::asio
 
+#include "connectionData.h"
+
+// 在websocketpp::config::asio的基础上, 把ConnectionData挂到每个连接上
+struct sigConfig : public websocketpp::config::asio {
+    typedef websocketpp::config::asio core;
+
+    typedef core::concurrency_type concurrency_type;
+    typedef core::request_type request_type;
+    typedef core::response_type response_type;
+    typedef core::message_type message_type;
+    typedef core::con_msg_manager_type con_msg_manager_type;
+    typedef core::endpoint_msg_manager_type endpoint_msg_manager_type;
+    typedef core::alog_type alog_type;
+    typedef core::elog_type elog_type;
+    typedef core::rng_type rng_type;
+    typedef core::transport_type transport_type;
+    typedef core::endpoint_base endpoint_base;
+
+    typedef ConnectionData connection_base;
+};
+
 class Type{
 public:
-    typedef websocketpp::server<websocketpp::config::asio> server;
+    typedef websocketpp::server<sigConfig> server;
     typedef websocketpp::connection_hdl connection_hdl;
     typedef server::connection_ptr connection_ptr;
     typedef server::message_ptr message_ptr;
     typedef websocketpp::frame::opcode::value opcode;
     typedef websocketpp::lib::error_code error_code;    
+    typedef websocketpp::lib::shared_ptr<websocketpp::lib::asio::ip::tcp::acceptor> acceptor_ptr;
 };
 
 
@@ -2,8 +2,64 @@
 
 #include <ctime>
 
+#include "outboundQueue.h"
+
+static thread_local std::vector<std::string> *captured = nullptr;
+static thread_local std::string_view request_id;
+
+// 过长的req_id不回显, 避免放大回复
+static const size_t kMaxRequestId = 128;
+
+ResponseCapture::ResponseCapture(std::vector<std::string> *out)
+    : prev_(captured) {
+    captured = out;
+}
+
+ResponseCapture::~ResponseCapture() { captured = prev_; }
+
+RequestScope::RequestScope(std::string_view raw) : prev_(request_id) {
+    int64_t id;
+    if (raw.size() <= kMaxRequestId && !raw.empty() &&
+        (raw.front() == '"' || rawToInt64(raw, &id)))
+        request_id = raw;
+    else
+        request_id = std::string_view();
+}
+
+RequestScope::~RequestScope() { request_id = prev_; }
+
+std::string_view peekRequestId(std::string_view payload) {
+    RawField field = {"req_id", {}};
+    if (!scanFields(payload, &field, 1))
+        return std::string_view();
+    return field.raw;
+}
+
+void reply(Type::connection_ptr con, std::string text) {
+    if (!request_id.empty() && text.size() > 1 && text.front() == '{') {
+        std::string tag = "\"req_id\":";
+        tag.append(request_id);
+        if (text[1] != '}')
+            tag.push_back(',');
+        text.insert(1, tag);
+    }
+    if (captured) {
+        captured->push_back(std::move(text));
+        return;
+    }
+    // 已登录的连接走peer的发送队列, 不会越过排在前面还没发出的信令
+    std::shared_ptr<OutboundQueue> out = con->outbound();
+    if (!out) {
+        con->send(text);
+        return;
+    }
+    Type::message_ptr msg = con->get_message(Type::opcode::TEXT, text.size());
+    msg->get_payload() = std::move(text);
+    out->push(std::move(msg), OutboundQueue::SIGNALING);
+}
+
 void response(Type::connection_ptr con, const std::string &msg) {
-    con->send("{\"msg\":\"" + msg + "\"}");
+    reply(con, "{\"msg\":\"" + msg + "\"}");
 }
 
 void response(Type::connection_ptr con, const std::string &msg,
@@ -17,19 +73,37 @@ void response(Type::connection_ptr con, const std::string &msg,
             << (isNumber ? "" : "\"");
     }
     res << "}";
-    con->send(res.str());
+    reply(con, res.str());
 }
 
 std::string getString(const rapidjson::Document &doc) {
-    rapidjson::StringBuffer buffer;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-    doc.Accept(writer);
-    return buffer.GetString();
+    std::string out;
+    writeString(doc, &out);
+    return out;
 }
 
-std::string nowTime() {
-    std::time_t currentTime = std::time(nullptr);
-    struct tm *tmTime = std::localtime(&currentTime);
+void writeString(const rapidjson::Value &value, std::string *out) {
+    StringWriteStream stream(out);
+    rapidjson::Writer<StringWriteStream> writer(stream);
+    value.Accept(writer);
+}
+
+Type::message_ptr makeMessage(Type::connection_ptr con,
+                              const rapidjson::Document &doc, size_t reserve) {
+    Type::message_ptr msg = con->get_message(Type::opcode::TEXT, reserve);
+    writeString(doc, &msg->get_payload());
+    return msg;
+}
+
+std::string nowTime() { return formatTime(std::time(nullptr)); }
+
+std::string formatTime(int64_t time) {
+    // 0表示没有设置过, 比如还没离开的peer的leftTime, 不写成1970-01-01
+    if (time == 0)
+        return std::string();
+    std::time_t currentTime = static_cast<std::time_t>(time);
+    struct tm tmBuffer;
+    struct tm *tmTime = localtime_r(&currentTime, &tmBuffer);
 
     // 格式化为 DATETIME 字符串
     char datetimeBuffer[20];
@@ -2,21 +2,82 @@
 #define _UTIL_H_
 
 #include <sstream>
+#include <string_view>
 #include <vector>
 
 #include "rapidjson/document.h"
 #include "rapidjson/rapidjson.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
+#include "rawJson.h"
 #include "type.h"
 
+// 发给请求方的回复都经过reply, 批量请求时会被ResponseCapture收集起来;
+// 已登录的连接经过peer的发送队列发出
+void reply(Type::connection_ptr con, std::string text);
+
+// 作用域内本线程通过reply发出的回复追加到out, 而不是直接发送
+class ResponseCapture {
+public:
+    explicit ResponseCapture(std::vector<std::string> *out);
+    ~ResponseCapture();
+    ResponseCapture(const ResponseCapture &) = delete;
+    ResponseCapture &operator=(const ResponseCapture &) = delete;
+
+private:
+    std::vector<std::string> *prev_;
+};
+
+// 作用域内本线程发出的回复都带上客户端的"req_id":raw, raw是原始的json文本,
+// 只接受字符串或整数, 其他的忽略
+class RequestScope {
+public:
+    explicit RequestScope(std::string_view raw);
+    ~RequestScope();
+    RequestScope(const RequestScope &) = delete;
+    RequestScope &operator=(const RequestScope &) = delete;
+
+private:
+    std::string_view prev_;
+};
+
+// 不解析整个json, 取顶层对象里req_id的原始json文本, 没有时为空
+std::string_view peekRequestId(std::string_view payload);
+
 void response(Type::connection_ptr con, const std::string &msg);
 
 void response(Type::connection_ptr con, const std::string &msg,
                      const std::vector<std::string> &kv);
 
+// rapidjson的输出流, 直接追加到std::string(比如待发送消息的payload)后面
+class StringWriteStream {
+public:
+    typedef char Ch;
+    explicit StringWriteStream(std::string *out) : out_(out) {}
+    void Put(char c) { out_->push_back(c); }
+    void Flush() {}
+
+private:
+    std::string *out_;
+};
+
 std::string getString(const rapidjson::Document &doc);
 
+// 把value序列化后追加到out, 不经过中间的StringBuffer
+void writeString(const rapidjson::Value &value, std::string *out);
+
+// 在con上申请一个消息, 把doc直接序列化到它的payload里
+Type::message_ptr makeMessage(Type::connection_ptr con,
+                              const rapidjson::Document &doc,
+                              size_t reserve = 256);
+
+// 引用s而不拷贝, s必须比使用它的Document活得长
+inline rapidjson::GenericStringRef<char> jsonRef(std::string_view s) {
+    return rapidjson::StringRef(s.data(), s.size());
+}
+
 std::string nowTime();
+// unix秒格式化成DATETIME字符串, 0(未设置)时为空字符串
+std::string formatTime(int64_t time);
 
 #endif  // _UTIL_H_
\ No newline at end of file
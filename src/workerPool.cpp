@@ -1,15 +1,63 @@
 #include "workerPool.h"
 
+#include <algorithm>
+
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 #include "util.h"
 #include "operate.h"
+#include "rateLimiter.h"
 
 log4cxx::LoggerPtr WorkerPool::logger_ = log4cxx::Logger::getLogger("server");
 
-WorkerPool::WorkerPool():count_(8) {
+static int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+WorkerPool::WorkerPool() : WorkerPool(Config()) {}
+
+WorkerPool::WorkerPool(const Config &config)
+    : min_count_(config.min_count < 1 ? 1 : config.min_count),
+      max_count_(config.max_count < min_count_ ? min_count_
+                                               : config.max_count),
+      active_(std::min(std::max(kInitialCount, min_count_), max_count_)),
+      schedule_(config.schedule),
+      batch_size_(config.batch_size < 1 ? 1 : config.batch_size),
+      start_(false),
+      slots_(new Slot[kSlotCount]),
+      stats_(new WorkerStat[max_count_]),
+      migrations_(0),
+      depth_(0),
+      bytes_(0),
+      high_depth_(config.high_depth),
+      low_depth_(std::min(config.low_depth, config.high_depth)),
+      high_bytes_(config.high_bytes),
+      low_bytes_(std::min(config.low_bytes, config.high_bytes)),
+      shedding_(false),
+      shed_(new std::atomic<uint64_t>[LANE_COUNT]),
+      limiter_(nullptr) {
+    for (int i = 0; i < LANE_COUNT; i++) {
+        shed_[i] = 0;
+    }
     room_manager_ = RoomManager::getInstance();
     peer_manager_ = PeerManager::getInstance();
+    std::vector<int> weights(config.lane_weights);
+    weights.resize(LANE_COUNT, 1);
+    if (schedule_ == Schedule::SHARED) {
+        inputs_.emplace_back(new DispatchQueue<Context>(16384, weights));
+    } else {
+        // 按上限分配队列, 扩缩容时只调整slot归属
+        size_t capacity = std::max<size_t>(2048, 16384 / max_count_);
+        for (int i = 0; i < max_count_; i++) {
+            inputs_.emplace_back(new DispatchQueue<Context>(capacity, weights));
+        }
+        for (int i = 0; i < kSlotCount; i++) {
+            slots_[i].worker = i % active_;
+        }
+    }
+    threads_.resize(max_count_);
 }
 
 WorkerPool::~WorkerPool() { stop(); }
@@ -18,42 +66,439 @@ void WorkerPool::init() {}
 
 void WorkerPool::start() {
     start_ = true;
-    for (int i = 0; i < count_; i++) {
-        threads_.push_back(std::thread(&WorkerPool::run, this));
+    {
+        std::lock_guard<std::mutex> lock(resize_mu_);
+        for (int i = 0; i < active_; i++) {
+            stats_[i].running = true;
+            threads_[i] = std::thread(&WorkerPool::run, this, i);
+        }
     }
-    LOG4CXX_INFO(logger_, "start " << count_ << " worker");
+    monitor_ = std::thread(&WorkerPool::monitor, this);
+    LOG4CXX_INFO(logger_, "start " << active_ << " worker(min " << min_count_
+                                   << ", max " << max_count_ << "), schedule: "
+                                   << (schedule_ == Schedule::SHARED
+                                           ? "shared"
+                                           : "affinity")
+                                   << ", batch size: " << batch_size_
+                                   << ", lane capacity: "
+                                   << inputs_[0]->capacity(0));
 }
 
 void WorkerPool::stop() {
     start_ = false;
-    for (int i = 0; i < count_; i++) {
-        threads_[i].join();
+    for (auto &input : inputs_) {
+        input->stop();
+    }
+    {
+        std::lock_guard<std::mutex> lock(monitor_mu_);
+        monitor_cv_.notify_all();
+    }
+    if (monitor_.joinable())
+        monitor_.join();
+    // 退出中的worker会去拿resize_mu_, 不能持锁join
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(resize_mu_);
+        threads.swap(threads_);
+        threads_.resize(max_count_);
     }
-    LOG4CXX_INFO(logger_, "stop " << count_ << " worker");
+    bool stopped = false;
+    for (auto &t : threads) {
+        if (t.joinable()) {
+            t.join();
+            stopped = true;
+        }
+    }
+    if (stopped)
+        LOG4CXX_INFO(logger_, "stop " << active_ << " worker");
+}
+
+void WorkerPool::setWatermarks(size_t high_depth, size_t low_depth,
+                               size_t high_bytes, size_t low_bytes) {
+    high_depth_ = high_depth;
+    low_depth_ = std::min(low_depth, high_depth);
+    high_bytes_ = high_bytes;
+    low_bytes_ = std::min(low_bytes, high_bytes);
+}
+
+void WorkerPool::setRateLimiter(const RateLimiter *limiter) {
+    limiter_ = limiter;
 }
 
-void WorkerPool::addContext(const Context &context) { input_.push(context); }
+// 超过高水位后拒绝低优先级操作, 降到低水位以下再恢复
+bool WorkerPool::admit(const Context &context) {
+    size_t depth = depth_.load(std::memory_order_relaxed);
+    size_t bytes = bytes_.load(std::memory_order_relaxed);
+    bool shedding = shedding_.load(std::memory_order_relaxed);
+    if (!shedding && (depth > high_depth_ || bytes > high_bytes_)) {
+        if (shedding_.compare_exchange_strong(shedding, true))
+            LOG4CXX_WARN(logger_, "start shedding, queued " << depth
+                                      << " contexts, " << bytes << " bytes");
+        shedding = true;
+    } else if (shedding && depth < low_depth_ && bytes < low_bytes_) {
+        if (shedding_.compare_exchange_strong(shedding, false))
+            LOG4CXX_WARN(logger_, "stop shedding, queued " << depth
+                                      << " contexts, " << bytes << " bytes");
+        shedding = false;
+    }
+    if (shedding && context.lane_ >= MESSAGING) {
+        shed_[context.lane_]++;
+        return false;
+    }
+    return true;
+}
 
-void WorkerPool::run() {
-    Context context;
+// 排队满了直接回复server busy, 不解析整个消息, 只取出req_id回显
+static void rejectBusy(const Context &context) {
+    RequestScope scope(peekRequestId(context.msg_->get_payload()));
+    response(context.con_, "server busy");
+}
+
+void WorkerPool::addContext(const Context &context) {
+    Context routed(context);
+    const std::string &payload = context.msg_->get_payload();
+    routed.enqueue_time_ = std::chrono::steady_clock::now();
+    routed.bytes_ = payload.size();
+    if (!admit(routed)) {
+        rejectBusy(context);
+        return;
+    }
+    // 先计数, 避免worker处理完减计数时出现下溢
+    depth_++;
+    bytes_ += routed.bytes_;
+    if (schedule_ == Schedule::SHARED) {
+        if (!inputs_[0]->push(routed, routed.lane_)) {
+            depth_--;
+            bytes_ -= routed.bytes_;
+            LOG4CXX_WARN(logger_, "input lane " << routed.lane_
+                                      << " is full, capacity: "
+                                      << inputs_[0]->capacity(routed.lane_)
+                                      << ", overflow: "
+                                      << inputs_[0]->overflow(routed.lane_));
+            rejectBusy(context);
+        }
+        return;
+    }
+
+    routed.slot_ = route(routed);
+    Slot &slot = slots_[routed.slot_];
+    std::lock_guard<std::mutex> lock(slot.mu);
+    // slot中没有未处理完的消息时可以安全地换worker:
+    // 原worker已缩容退出, 或者积压明显多于最空闲的worker
+    if (slot.pending.load() == 0 &&
+        (slot.worker >= active_.load() ||
+         inputs_[slot.worker]->size() > kRebalanceThreshold)) {
+        int target = leastLoaded();
+        if (slot.worker >= active_.load() ||
+            inputs_[slot.worker]->size() >
+                inputs_[target]->size() + kRebalanceThreshold) {
+            slot.worker = target;
+            migrations_++;
+        }
+    }
+    // 连接的消息排空之前沿用之前的lane, 保证同一个连接内的顺序
+    ConnectionData *data = routed.con_.get();
+    if (data->pending_.load() == 0)
+        data->lane_ = routed.lane_;
+    int lane = data->lane_;
+    slot.pending++;
+    data->pending_++;
+    if (!inputs_[slot.worker]->push(routed, lane)) {
+        slot.pending--;
+        data->pending_--;
+        depth_--;
+        bytes_ -= routed.bytes_;
+        LOG4CXX_WARN(logger_, "input lane " << lane << " of worker "
+                                  << slot.worker << " is full, capacity: "
+                                  << inputs_[slot.worker]->capacity(lane)
+                                  << ", overflow: "
+                                  << inputs_[slot.worker]->overflow(lane));
+        rejectBusy(context);
+    }
+}
+
+// 按连接路由: 同一个连接的所有消息(不管操作哪个房间)都在同一个slot里串行,
+// 不会因为有没有rid落到不同的worker而被重排. 房间的并发访问由房间自己的锁保护
+int WorkerPool::route(const Context &context) {
+    uint64_t key = reinterpret_cast<uintptr_t>(context.con_.get());
+    return static_cast<int>((key * 0x9E3779B97F4A7C15ULL) >>
+                            (64 - kSlotBits));
+}
+
+int WorkerPool::leastLoaded() {
+    int active = active_.load();
+    int target = 0;
+    size_t min_size = inputs_[0]->size();
+    for (int i = 1; i < active; i++) {
+        size_t size = inputs_[i]->size();
+        if (size < min_size) {
+            min_size = size;
+            target = i;
+        }
+    }
+    return target;
+}
+
+void WorkerPool::run(int index) {
+    DispatchQueue<Context> &input =
+        schedule_ == Schedule::SHARED ? *inputs_[0] : *inputs_[index];
+    WorkerStat &stat = stats_[index];
+    std::vector<Context> batch;
+    batch.reserve(batch_size_);
+    int idle_ms = 0;
     while (start_) {
-        if (!input_.get(&context, 30000)) {
-            LOG4CXX_INFO(logger_, "No context in input");
+        if (stat.retiring.load()) {
+            std::lock_guard<std::mutex> lock(resize_mu_);
+            if (stat.retiring.load() && retire(index)) {
+                stat.retiring = false;
+                stat.running = false;
+                LOG4CXX_INFO(logger_, "worker " << index << " retired");
+                return;
+            }
+        }
+        batch.clear();
+        if (input.getBatch(&batch, batch_size_, kIdleWaitMs) == 0) {
+            if ((idle_ms += kIdleWaitMs) >= 30000) {
+                LOG4CXX_INFO(logger_, "No context in input");
+                idle_ms = 0;
+            }
+            continue;
+        }
+        idle_ms = 0;
+        auto begin = std::chrono::steady_clock::now();
+        stat.busy_since_us = nowUs();
+        uint64_t wait_us = 0;
+        for (auto &context : batch) {
+            wait_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                           begin - context.enqueue_time_)
+                           .count();
+        }
+        processBatch(batch);
+        size_t bytes = 0;
+        for (auto &context : batch) {
+            if (context.slot_ >= 0) {
+                slots_[context.slot_].pending--;
+                context.con_->pending_--;
+            }
+            bytes += context.bytes_;
+        }
+        depth_ -= batch.size();
+        bytes_ -= bytes;
+        // monitor可能已经把busy_since_us推进到上一次统计的时间,
+        // 这里只补上之后的部分
+        stat.busy_us += nowUs() - stat.busy_since_us.exchange(0);
+        stat.wait_us += wait_us;
+        stat.processed += batch.size();
+        stat.batches++;
+    }
+    stat.running = false;
+}
+
+// 持有resize_mu_调用. 把仍属于该worker且没有未处理消息的slot交给活跃worker,
+// 全部交出后该worker不会再收到新消息, 可以退出
+bool WorkerPool::retire(int index) {
+    if (schedule_ == Schedule::SHARED)
+        return true;
+    bool done = true;
+    for (int i = 0; i < kSlotCount; i++) {
+        Slot &slot = slots_[i];
+        std::lock_guard<std::mutex> lock(slot.mu);
+        if (slot.worker != index)
+            continue;
+        if (slot.pending.load() != 0) {
+            done = false;
             continue;
         }
+        slot.worker = leastLoaded();
+        migrations_++;
+    }
+    return done && inputs_[index]->size() == 0;
+}
+
+void WorkerPool::grow(const std::string &reason) {
+    std::lock_guard<std::mutex> lock(resize_mu_);
+    int index = active_.load();
+    if (!start_ || index >= max_count_)
+        return;
+    WorkerStat &stat = stats_[index];
+    if (stat.running.load()) {
+        // 还在退出中的worker直接恢复
+        stat.retiring = false;
+    } else {
+        if (threads_[index].joinable())
+            threads_[index].join();
+        stat.retiring = false;
+        stat.running = true;
+        threads_[index] = std::thread(&WorkerPool::run, this, index);
+    }
+    active_++;
+    LOG4CXX_INFO(logger_, "grow workers " << index << " -> " << index + 1
+                                          << ", because " << reason);
+}
+
+void WorkerPool::shrink(const std::string &reason) {
+    std::lock_guard<std::mutex> lock(resize_mu_);
+    int active = active_.load();
+    if (!start_ || active <= min_count_)
+        return;
+    // 先减少active_, 新消息不再路由到该worker
+    active_--;
+    stats_[active - 1].retiring = true;
+    LOG4CXX_INFO(logger_, "shrink workers " << active << " -> " << active - 1
+                                            << ", because " << reason);
+}
+
+// 按到达顺序逐个处理, 同一个routing key的消息不会被重排.
+// 不持有房间锁, 房间和会话的状态修改在各自内部加锁, 广播在快照上进行
+void WorkerPool::processBatch(std::vector<Context> &batch) {
+    for (auto &context : batch) {
         try {
             process(context);
         } catch (const std::exception &e) {
-            LOG4CXX_ERROR(logger_,
-                          "failed to process context because:" << e.what());
+            LOG4CXX_ERROR(logger_, "failed to process context because:"
+                                       << e.what());
+        }
+    }
+}
+
+// 根据排队延迟和利用率伸缩worker数, 并定期输出各worker的负载分布
+void WorkerPool::monitor() {
+    std::vector<uint64_t> processed(max_count_, 0);
+    uint64_t batches = 0;
+    int tick = 0;
+    int hot_ticks = 0;
+    int idle_ticks = 0;
+    while (start_) {
+        {
+            std::unique_lock<std::mutex> lock(monitor_mu_);
+            monitor_cv_.wait_for(lock,
+                                 std::chrono::milliseconds(kMonitorIntervalMs),
+                                 [this] { return !start_; });
+        }
+        if (!start_)
+            break;
+
+        int64_t now_us = nowUs();
+        uint64_t count = 0;
+        uint64_t wait_us = 0;
+        uint64_t busy_us = 0;
+        int stalled = 0;
+        for (int i = 0; i < max_count_; i++) {
+            uint64_t n = stats_[i].processed.exchange(0);
+            processed[i] += n;
+            count += n;
+            batches += stats_[i].batches.exchange(0);
+            wait_us += stats_[i].wait_us.exchange(0);
+            busy_us += stats_[i].busy_us.exchange(0);
+            // 还没处理完的batch也算繁忙, 比如被数据库卡住的worker.
+            // 只计入上次统计之后的部分, 并把起点推进到现在, 避免batch
+            // 结束时再按完整耗时重复计入. 交换失败说明batch刚结束,
+            // 由worker自己计入
+            int64_t since = stats_[i].busy_since_us.load();
+            if (since != 0 &&
+                stats_[i].busy_since_us.compare_exchange_strong(since,
+                                                                now_us)) {
+                int64_t busy = now_us - since;
+                busy_us += std::min<int64_t>(busy, kMonitorIntervalMs * 1000);
+                // 整个统计周期都在处理同一个batch
+                if (busy >= kMonitorIntervalMs * 1000)
+                    stalled++;
+            }
+        }
+        size_t queued = 0;
+        for (auto &input : inputs_) {
+            queued += input->size();
+        }
+        int active = active_.load();
+        double avg_wait_ms = count == 0 ? 0.0 : wait_us / 1000.0 / count;
+        double utilization = std::min(
+            1.0, busy_us / (1000.0 * kMonitorIntervalMs * active));
+
+        std::stringstream reason;
+        reason << "avg queue wait " << avg_wait_ms << "ms, utilization "
+               << utilization << ", queued " << queued << ", stalled "
+               << stalled;
+        if (utilization > kGrowUtilization &&
+            (avg_wait_ms > kGrowWaitMs || (queued > 0 && stalled > 0))) {
+            idle_ticks = 0;
+            if (++hot_ticks >= kGrowTicks && active < max_count_) {
+                grow(reason.str());
+                hot_ticks = 0;
+            }
+        } else if (utilization < kShrinkUtilization &&
+                   avg_wait_ms < kShrinkWaitMs) {
+            hot_ticks = 0;
+            if (++idle_ticks >= kShrinkTicks && active > min_count_) {
+                shrink(reason.str());
+                idle_ticks = 0;
+            }
+        } else {
+            hot_ticks = 0;
+            idle_ticks = 0;
+        }
+
+        if (++tick % kStatsEvery != 0)
+            continue;
+        std::stringstream ss;
+        uint64_t total = 0;
+        uint64_t max = 0;
+        std::vector<size_t> lanes(LANE_COUNT, 0);
+        for (auto &input : inputs_) {
+            for (int l = 0; l < LANE_COUNT; l++) lanes[l] += input->size(l);
+        }
+        for (int i = 0; i < active; i++) {
+            total += processed[i];
+            max = std::max(max, processed[i]);
+            ss << " " << i << ":" << processed[i] << "/"
+               << (schedule_ == Schedule::SHARED ? inputs_[0]->size()
+                                                 : inputs_[i]->size());
         }
+        // imbalance = 最忙worker处理量 / 平均处理量, 1.0表示完全均衡
+        double imbalance = total == 0 ? 1.0 : (double)max * active / total;
+        std::stringstream limited;
+        for (int l = 0; l < LANE_COUNT; l++) {
+            limited << (l == 0 ? "" : "/")
+                    << (limiter_ == nullptr ? 0 : limiter_->dropped(l));
+        }
+        OutboundQueue::Stats outbound = OutboundQueue::stats();
+        LOG4CXX_INFO(logger_, "workers: " << active << "(min " << min_count_
+                                  << ", max " << max_count_ << "), "
+                                  << reason.str()
+                                  << ", load(processed/queued):" << ss.str()
+                                  << ", imbalance: " << imbalance
+                                  << ", avg batch: "
+                                  << (batches == 0 ? 0.0
+                                                   : (double)total / batches)
+                                  << ", slot migrations: "
+                                  << migrations_.load() << ", queued by lane: "
+                                  << lanes[NEGOTIATION] << "/"
+                                  << lanes[SESSION_CONTROL] << "/"
+                                  << lanes[MESSAGING] << "/" << lanes[QUERY]
+                                  << ", queued bytes: " << bytes_.load()
+                                  << ", shedding: " << shedding_.load()
+                                  << ", shed messaging/query: "
+                                  << shed_[MESSAGING].load() << "/"
+                                  << shed_[QUERY].load()
+                                  << ", rate limited by lane: "
+                                  << limited.str()
+                                  << ", outbound queued bytes: "
+                                  << outbound.queued_bytes
+                                  << ", dropped/coalesced/disconnected: "
+                                  << outbound.dropped << "/"
+                                  << outbound.coalesced << "/"
+                                  << outbound.disconnected
+                                  << ", batched messages/frames: "
+                                  << outbound.batch_messages << "/"
+                                  << outbound.batch_frames);
+        std::fill(processed.begin(), processed.end(), 0);
+        batches = 0;
     }
 }
 
 inline bool WorkerPool::getFromPid(Type::connection_ptr con,
-                                   rapidjson::Document &doc, int64_t *from_pid,
+                                   rapidjson::Value &doc, int64_t *from_pid,
                                    bool sendError) {
-    if (doc.HasMember("from_pid") && doc["from_pid"].IsInt()) {
+    if (doc.HasMember("from_pid") && doc["from_pid"].IsInt64()) {
         *from_pid = doc["from_pid"].GetInt64();
         return true;
     } else if (sendError) {
@@ -63,9 +508,9 @@ inline bool WorkerPool::getFromPid(Type::connection_ptr con,
 }
 
 inline bool WorkerPool::getDestPid(Type::connection_ptr con,
-                                   rapidjson::Document &doc, int64_t *dest_pid,
+                                   rapidjson::Value &doc, int64_t *dest_pid,
                                    bool sendError) {
-    if (doc.HasMember("dest_pid") && doc["dest_pid"].IsInt()) {
+    if (doc.HasMember("dest_pid") && doc["dest_pid"].IsInt64()) {
         *dest_pid = doc["dest_pid"].GetInt64();
         return true;
     } else if (sendError) {
@@ -74,10 +519,31 @@ inline bool WorkerPool::getDestPid(Type::connection_ptr con,
     return false;
 }
 
+inline bool WorkerPool::getDestPids(Type::connection_ptr con,
+                                    rapidjson::Value &doc,
+                                    std::vector<int64_t> *dest_pids) {
+    if (!doc.HasMember("dest_pids"))
+        return true;
+    const rapidjson::Value &pids = doc["dest_pids"];
+    if (!pids.IsArray() || pids.Empty() || pids.Size() > kMaxMulticast) {
+        response(con, "dest_pids must be a non-empty array of pid");
+        return false;
+    }
+    dest_pids->reserve(pids.Size());
+    for (rapidjson::SizeType i = 0; i < pids.Size(); i++) {
+        if (!pids[i].IsInt64()) {
+            response(con, "dest_pids must be a non-empty array of pid");
+            return false;
+        }
+        dest_pids->push_back(pids[i].GetInt64());
+    }
+    return true;
+}
+
 inline bool WorkerPool::getRid(Type::connection_ptr con,
-                               rapidjson::Document &doc, int64_t *rid,
+                               rapidjson::Value &doc, int64_t *rid,
                                bool sendError) {
-    if (doc.HasMember("rid") && doc["rid"].IsInt()) {
+    if (doc.HasMember("rid") && doc["rid"].IsInt64()) {
         *rid = doc["rid"].GetInt64();
         return true;
     } else if (sendError) {
@@ -86,10 +552,15 @@ inline bool WorkerPool::getRid(Type::connection_ptr con,
     return false;
 }
 
+static std::string_view viewOf(const rapidjson::Value &value) {
+    return std::string_view(value.GetString(), value.GetStringLength());
+}
+
 inline bool WorkerPool::getName(Type::connection_ptr con,
-                                rapidjson::Document &doc, std::string *name,
-                                bool sendError) {
-    if (doc.HasMember("name") && doc["name"].IsString() && !(*name = doc["name"].GetString()).empty()) {
+                                rapidjson::Value &doc,
+                                std::string_view *name, bool sendError) {
+    if (doc.HasMember("name") && doc["name"].IsString() &&
+        !(*name = viewOf(doc["name"])).empty()) {
         return true;
     } else if (sendError) {
         response(con, "please provide your name!");
@@ -98,10 +569,10 @@ inline bool WorkerPool::getName(Type::connection_ptr con,
 }
 
 inline bool WorkerPool::getMsg(Type::connection_ptr con,
-                               rapidjson::Document &doc, std::string *msg,
-                               bool sendError) {
+                               rapidjson::Value &doc,
+                               std::string_view *msg, bool sendError) {
     if (doc.HasMember("msg") && doc["msg"].IsString()) {
-        *msg = doc["msg"].GetString();
+        *msg = viewOf(doc["msg"]);
         return true;
     } else if (sendError) {
         response(con, "please provide your msg!");
@@ -109,20 +580,210 @@ inline bool WorkerPool::getMsg(Type::connection_ptr con,
     return false;
 }
 
+inline bool WorkerPool::getCount(Type::connection_ptr con,
+                                 rapidjson::Value &doc, const char *key,
+                                 size_t *count) {
+    if (!doc.HasMember(key))
+        return true;
+    if (doc[key].IsUint() && doc[key].GetUint() > 0) {
+        *count = doc[key].GetUint();
+        return true;
+    }
+    response(con, std::string(key) + " must be a positive integer");
+    return false;
+}
+
+inline bool WorkerPool::getCursor(Type::connection_ptr con,
+                                  rapidjson::Value &doc,
+                                  NameIndex::Entry *after, bool *has_after) {
+    if (!doc.HasMember("after"))
+        return true;
+    rapidjson::Value &cursor = doc["after"];
+    if (!cursor.IsObject() || !cursor.HasMember("name") ||
+        !cursor["name"].IsString() || !cursor.HasMember("pid") ||
+        !cursor["pid"].IsInt64()) {
+        response(con, "after must be the next of the previous page");
+        return false;
+    }
+    after->first.assign(cursor["name"].GetString(),
+                        cursor["name"].GetStringLength());
+    after->second = cursor["pid"].GetInt64();
+    *has_after = true;
+    return true;
+}
+
+inline bool WorkerPool::getRaw(Type::connection_ptr con,
+                               rapidjson::Value &doc, const char *key,
+                               std::string *storage, std::string_view *raw,
+                               const char *error) {
+    if (doc.HasMember(key) && doc[key].IsString()) {
+        writeString(doc[key], storage);
+        *raw = *storage;
+        return true;
+    }
+    response(con, error);
+    return false;
+}
+
 // here
+// 转发SDP/ICE时只需要operate, from_pid, rid, dest_pid(多播是dest_pids),
+// 不用解析和反转义巨大的offer, 直接把payload里原始的字符串拼到发出去的消息里.
+// 先预读operate确定要取的那一个负载字段, 只扫描需要的字段, 找齐后即停止.
+// 字段不全或格式不对时返回false, 交给完整解析的路径给出错误提示
+bool WorkerPool::relay(Context &context) {
+    const std::string &payload = context.msg_->get_payload();
+    int64_t opt;
+    if (!peekInt64(payload, "operate", &opt))
+        return false;
+    const char *key;
+    bool multicast = false;
+    switch (opt) {
+        case OPERATE::SEND_SDP_OFFER:
+            key = "offer";
+            break;
+        case OPERATE::SEND_SDP_ANSWER:
+            key = "answer";
+            break;
+        case OPERATE::SEND_ICE_CANDIDATE:
+            key = "candidate";
+            break;
+        case OPERATE::MULTICAST_SDP_OFFER:
+            key = "offer";
+            multicast = true;
+            break;
+        case OPERATE::MULTICAST_ICE_CANDIDATE:
+            key = "candidate";
+            multicast = true;
+            break;
+        default:
+            return false;
+    }
+    enum { FROM_PID, RID, DEST, RAW, REQ_ID };
+    RawField fields[] = {{"from_pid", {}},
+                         {"rid", {}},
+                         {multicast ? "dest_pids" : "dest_pid", {}},
+                         {key, {}},
+                         {"req_id", {}}};
+    if (!scanFields(payload, fields, sizeof(fields) / sizeof(fields[0])))
+        return false;
+    int64_t from_pid, rid, dest_pid;
+    std::vector<int64_t> dest_pids;
+    if (!rawToInt64(fields[FROM_PID].raw, &from_pid) ||
+        !rawToInt64(fields[RID].raw, &rid))
+        return false;
+    if (multicast ? !rawToPids(fields[DEST].raw, &dest_pids)
+                  : !rawToInt64(fields[DEST].raw, &dest_pid))
+        return false;
+    std::string_view raw = fields[RAW].raw;
+    if (raw.empty() || raw.front() != '"')
+        return false;
+    Type::connection_ptr &con = context.con_;
+    RequestScope scope(fields[REQ_ID].raw);
+    switch (opt) {
+        case OPERATE::SEND_SDP_OFFER:
+            room_manager_->sendSDPOffer(con, rid, from_pid, dest_pid, raw);
+            break;
+        case OPERATE::SEND_SDP_ANSWER:
+            room_manager_->sendSDPAnswer(con, rid, from_pid, dest_pid, raw);
+            break;
+        case OPERATE::SEND_ICE_CANDIDATE:
+            room_manager_->sendICECandidate(con, rid, from_pid, dest_pid, raw);
+            break;
+        case OPERATE::MULTICAST_SDP_OFFER:
+            room_manager_->multicastSDPOffer(con, rid, from_pid, dest_pids,
+                                             raw);
+            break;
+        case OPERATE::MULTICAST_ICE_CANDIDATE:
+            room_manager_->multicastICECandidate(con, rid, from_pid, dest_pids,
+                                                 raw);
+            break;
+    }
+    return true;
+}
+
+// 多播的dest_pids: 没有时为空(发给所有会话成员), 否则是1到kMaxMulticast个pid.
+// 和getDestPids的规则一致, 不合法时返回false交给完整解析的路径报错
+bool WorkerPool::rawToPids(std::string_view raw,
+                           std::vector<int64_t> *dest_pids) {
+    if (raw.empty())
+        return true;
+    std::vector<std::string_view> items;
+    if (!splitArray(raw, &items, kMaxMulticast) || items.empty())
+        return false;
+    dest_pids->reserve(items.size());
+    for (std::string_view item : items) {
+        int64_t pid;
+        if (!rawToInt64(item, &pid))
+            return false;
+        dest_pids->push_back(pid);
+    }
+    return true;
+}
+
 void WorkerPool::process(Context &context) {
     const Type::message_ptr &msg_ptr = context.msg_;
     Type::connection_ptr &con = context.con_;
 
+    if (!context.batch_ && context.lane_ == NEGOTIATION && relay(context))
+        return;
+
     // 解析json
     rapidjson::Document doc;
     // payload:{"operate":xxx,"body":xxx, ...}
-    std::string payload = msg_ptr->get_payload();
-    doc.Parse(payload.c_str());
-    if (doc.HasParseError() || !doc.IsObject()) {
+    // 直接在消息自己的payload上原地解析, 字符串值指向payload内部不再拷贝,
+    // 之后payload的内容已被改写, 不能再当作原始消息使用
+    std::string &payload = msg_ptr->get_payload();
+    doc.ParseInsitu(&payload[0]);
+    if (doc.HasParseError()) {
+        response(con, "Only json format data is supported!");
+        return;
+    }
+    if (context.batch_ && doc.IsArray()) {
+        processEnvelope(context, doc);
+        return;
+    }
+    handle(context, doc);
+}
+
+// 按顺序处理每个操作, 回复{"msg":"batch","results":[[...],...]},
+// results[i]是第i个操作产生的所有回复
+void WorkerPool::processEnvelope(Context &context, rapidjson::Value &ops) {
+    std::string out = "{\"msg\":\"batch\",\"results\":[";
+    for (rapidjson::SizeType i = 0; i < ops.Size(); i++) {
+        std::vector<std::string> replies;
+        {
+            ResponseCapture capture(&replies);
+            try {
+                handle(context, ops[i]);
+            } catch (const std::exception &e) {
+                LOG4CXX_ERROR(logger_, "failed to process batch item " << i
+                                           << " because:" << e.what());
+                response(context.con_, "internal error");
+            }
+        }
+        out.append(i == 0 ? "[" : ",[");
+        for (size_t j = 0; j < replies.size(); j++) {
+            if (j > 0)
+                out.push_back(',');
+            out.append(replies[j]);
+        }
+        out.push_back(']');
+    }
+    out.append("]}");
+    reply(context.con_, std::move(out));
+}
+
+void WorkerPool::handle(Context &context, rapidjson::Value &doc) {
+    Type::connection_ptr &con = context.con_;
+    if (!doc.IsObject()) {
         response(con, "Only json format data is supported!");
         return;
     }
+    // 客户端可选的req_id, 原样回显在这个请求的所有回复里
+    std::string req_id;
+    if (doc.HasMember("req_id"))
+        writeString(doc["req_id"], &req_id);
+    RequestScope scope(req_id);
     if (!doc.HasMember("operate") || !doc["operate"].IsInt()) {
         response(con, "please support right operate!");
         return;
@@ -133,8 +794,8 @@ void WorkerPool::process(Context &context) {
     int64_t from_pid;
     int64_t dest_pid;
     int64_t rid;
-    std::string name;
-    std::string msg;
+    std::string_view name;
+    std::string_view msg;
 
     switch (opt) {
         // peer
@@ -160,8 +821,21 @@ void WorkerPool::process(Context &context) {
                 peer_manager_->searchPeer(con, from_pid, dest_pid);
             } else if (getName(con, doc, &name, false)) {
                 peer_manager_->searchPeer(con, from_pid, name);
+            } else if (doc.HasMember("prefix") && doc["prefix"].IsString()) {
+                // 按名字前缀分页搜索, after/limit可选
+                size_t limit = PeerManager::kDefaultSearchLimit;
+                NameIndex::Entry after;
+                bool has_after = false;
+                if (!getCount(con, doc, "limit", &limit) ||
+                    !getCursor(con, doc, &after, &has_after))
+                    return;
+                peer_manager_->searchPeerPrefix(
+                    con, from_pid,
+                    std::string_view(doc["prefix"].GetString(),
+                                     doc["prefix"].GetStringLength()),
+                    has_after ? &after : nullptr, limit);
             } else {
-                response(con, "support dest_pid or name");
+                response(con, "support dest_pid, name or prefix");
             }
             break;
         case OPERATE::SEND_TO:
@@ -241,6 +915,20 @@ void WorkerPool::process(Context &context) {
             if (getFromPid(con, doc, &from_pid) && getRid(con, doc, &rid))
                 room_manager_->leftSession(con, rid, from_pid);
             break;
+        // 组合操作
+        case OPERATE::LOG_IN_JOIN_ROOM:
+        case OPERATE::LOG_IN_JOIN_SESSION:
+            if (!getName(con, doc, &name) || !getRid(con, doc, &rid))
+                return;
+            if (!getFromPid(con, doc, &from_pid, false))
+                from_pid = -1;
+            room_manager_->joinCall(con, rid, from_pid, &name,
+                                    opt == OPERATE::LOG_IN_JOIN_SESSION);
+            break;
+        case OPERATE::JOIN_ROOM_SESSION:
+            if (getFromPid(con, doc, &from_pid) && getRid(con, doc, &rid))
+                room_manager_->joinCall(con, rid, from_pid, nullptr, true);
+            break;
         case OPERATE::GET_SESSION_STATUS:
             if (getFromPid(con, doc, &from_pid) && getRid(con, doc, &rid))
                 room_manager_->getSessionStatus(con, rid);
@@ -253,13 +941,11 @@ void WorkerPool::process(Context &context) {
 
         // 会话协商
         case OPERATE::SEND_SDP_OFFER: {
-            std::string offer;
-            if (doc.HasMember("offer") && doc["offer"].IsString()) {
-                offer = doc["offer"].GetString();
-            } else {
-                response(con, "please provide your sdp offer!");
+            std::string storage;
+            std::string_view offer;
+            if (!getRaw(con, doc, "offer", &storage, &offer,
+                        "please provide your sdp offer!"))
                 return;
-            }
             if (getFromPid(con, doc, &from_pid) && getRid(con, doc, &rid) &&
                 getDestPid(con, doc, &dest_pid))
                 room_manager_->sendSDPOffer(con, rid, from_pid, dest_pid,
@@ -267,13 +953,11 @@ void WorkerPool::process(Context &context) {
             break;
         }
         case OPERATE::SEND_SDP_ANSWER: {
-            std::string answer;
-            if (doc.HasMember("answer") && doc["answer"].IsString()) {
-                answer = doc["answer"].GetString();
-            } else {
-                response(con, "please provide your sdp answer!");
+            std::string storage;
+            std::string_view answer;
+            if (!getRaw(con, doc, "answer", &storage, &answer,
+                        "please provide your sdp answer!"))
                 return;
-            }
             if (getFromPid(con, doc, &from_pid) && getRid(con, doc, &rid) &&
                 getDestPid(con, doc, &dest_pid))
                 room_manager_->sendSDPAnswer(con, rid, from_pid, dest_pid,
@@ -282,19 +966,43 @@ void WorkerPool::process(Context &context) {
         }
 
         case OPERATE::SEND_ICE_CANDIDATE: {
-            std::string candidate;
-            if (doc.HasMember("candidate") && doc["candidate"].IsString()) {
-                candidate = doc["candidate"].GetString();
-            } else {
-                response(con, "please provide your candidate!");
+            std::string storage;
+            std::string_view candidate;
+            if (!getRaw(con, doc, "candidate", &storage, &candidate,
+                        "please provide your candidate!"))
                 return;
-            }
             if (getFromPid(con, doc, &from_pid) && getRid(con, doc, &rid) &&
                 getDestPid(con, doc, &dest_pid))
                 room_manager_->sendICECandidate(con, rid, from_pid, dest_pid,
                                                 candidate);
             break;
         }
+        case OPERATE::MULTICAST_SDP_OFFER: {
+            std::string storage;
+            std::string_view offer;
+            std::vector<int64_t> dest_pids;
+            if (!getRaw(con, doc, "offer", &storage, &offer,
+                        "please provide your sdp offer!"))
+                return;
+            if (getFromPid(con, doc, &from_pid) && getRid(con, doc, &rid) &&
+                getDestPids(con, doc, &dest_pids))
+                room_manager_->multicastSDPOffer(con, rid, from_pid, dest_pids,
+                                                 offer);
+            break;
+        }
+        case OPERATE::MULTICAST_ICE_CANDIDATE: {
+            std::string storage;
+            std::string_view candidate;
+            std::vector<int64_t> dest_pids;
+            if (!getRaw(con, doc, "candidate", &storage, &candidate,
+                        "please provide your candidate!"))
+                return;
+            if (getFromPid(con, doc, &from_pid) && getRid(con, doc, &rid) &&
+                getDestPids(con, doc, &dest_pids))
+                room_manager_->multicastICECandidate(con, rid, from_pid,
+                                                     dest_pids, candidate);
+            break;
+        }
         case OPERATE::CONNECTED: {
             if (getFromPid(con, doc, &from_pid) && getRid(con, doc, &rid))
                 room_manager_->connected(con, rid, from_pid);
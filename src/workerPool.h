@@ -2,6 +2,10 @@
 #define _WORKERPOOL_H_
 
 #include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string_view>
 #include <thread>
 #include <vector>
 
@@ -9,42 +13,171 @@
 #include "log4cxx/log4cxx.h"
 #include "log4cxx/logger.h"
 #include "peerManager.h"
-#include "producerConsumerQueue.h"
+#include "dispatchQueue.h"
 #include "rapidjson/document.h"
 #include "roomManager.h"
 #include "type.h"
 
+class RateLimiter;
+
 class WorkerPool {
 public:
+    enum class Schedule {
+        // 所有worker竞争同一个队列
+        SHARED,
+        // 按连接哈希到固定worker, 同一连接的消息串行有序
+        AFFINITY,
+    };
+
+    struct Config {
+        // worker线程数的上下限, 根据排队延迟和利用率自动伸缩
+        int min_count = 2;
+        int max_count = 16;
+        Schedule schedule = Schedule::AFFINITY;
+        // worker每次唤醒最多取出的消息数
+        int batch_size = 32;
+        // 各优先级lane的出队权重, 下标见operate.h中的LANE
+        std::vector<int> lane_weights = {8, 4, 2, 1};
+        // 准入的高低水位, 见setWatermarks
+        size_t high_depth = 8192;
+        size_t low_depth = 4096;
+        size_t high_bytes = 64 << 20;
+        size_t low_bytes = 32 << 20;
+    };
 
     WorkerPool();
+    explicit WorkerPool(const Config &config);
     ~WorkerPool();
+    // context.lane_由调用方(sigServer::on_message)填好
     void addContext(const Context &context);
+    // 排队的消息数或字节数超过high时开始拒绝低优先级(MESSAGING/QUERY)操作,
+    // 两者都降到low以下后恢复
+    void setWatermarks(size_t high_depth, size_t low_depth, size_t high_bytes,
+                       size_t low_bytes);
+    // monitor定期输出各lane被入口限流丢弃的消息数, 在start之前设置
+    void setRateLimiter(const RateLimiter *limiter);
     void init();
     void start();
     void stop();
 
 private:
-    void run();
+    static constexpr int kSlotBits = 10;
+    static constexpr int kSlotCount = 1 << kSlotBits;
+    // 空闲slot所在worker的积压比最空闲的worker多出该值时, 把slot迁走
+    static constexpr size_t kRebalanceThreshold = 32;
+    static constexpr int kInitialCount = 8;
+    static constexpr int kIdleWaitMs = 1000;
+    static constexpr int kMonitorIntervalMs = 1000;
+    // 每隔多少次monitor输出一次负载分布
+    static constexpr int kStatsEvery = 10;
+    // 平均排队延迟超过该值且worker繁忙, 连续kGrowTicks次则扩容
+    static constexpr double kGrowWaitMs = 5.0;
+    static constexpr double kGrowUtilization = 0.7;
+    static constexpr int kGrowTicks = 2;
+    // 利用率低于该值且几乎不排队, 连续kShrinkTicks次则缩容
+    static constexpr double kShrinkWaitMs = 1.0;
+    static constexpr double kShrinkUtilization = 0.3;
+    static constexpr int kShrinkTicks = 10;
+    // 一次多播最多的接收者数
+    static constexpr rapidjson::SizeType kMaxMulticast = 64;
+
+    // 路由槽, 同一个slot同一时刻只属于一个worker
+    struct alignas(64) Slot {
+        std::mutex mu;
+        int worker = 0;
+        // 已入队但还没处理完的消息数, 为0时slot才能迁移, 保证FIFO
+        std::atomic<int> pending{0};
+    };
+
+    struct alignas(64) WorkerStat {
+        std::atomic<uint64_t> processed{0};
+        std::atomic<uint64_t> batches{0};
+        // 累计排队时间和处理时间, monitor每次取走
+        std::atomic<uint64_t> wait_us{0};
+        std::atomic<uint64_t> busy_us{0};
+        // 正在处理的batch还没计入busy_us的起点, 0表示空闲
+        std::atomic<int64_t> busy_since_us{0};
+        std::atomic<bool> running{false};
+        // 缩容时置位, worker交出所有slot并处理完队列后退出
+        std::atomic<bool> retiring{false};
+    };
+
+    bool admit(const Context &context);
+    void run(int index);
+    bool retire(int index);
+    void grow(const std::string &reason);
+    void shrink(const std::string &reason);
+    void processBatch(std::vector<Context> &batch);
+    void monitor();
+    int route(const Context &context);
+    int leastLoaded();
     void process(Context &context);
-    inline bool getFromPid(Type::connection_ptr con, rapidjson::Document &doc,
+    // 处理批量请求, 各操作的回复合成一帧
+    void processEnvelope(Context &context, rapidjson::Value &ops);
+    // 处理一个{operate,...}
+    void handle(Context &context, rapidjson::Value &doc);
+    // 协商消息的快速路径, 只扫描路由字段, 处理了返回true
+    bool relay(Context &context);
+    static bool rawToPids(std::string_view raw,
+                          std::vector<int64_t> *dest_pids);
+    inline bool getFromPid(Type::connection_ptr con, rapidjson::Value &doc,
                            int64_t *from_pid, bool sendError = true);
-    inline bool getDestPid(Type::connection_ptr con, rapidjson::Document &doc,
+    inline bool getDestPid(Type::connection_ptr con, rapidjson::Value &doc,
                            int64_t *dest_pid, bool sendError = true);
-    inline bool getRid(Type::connection_ptr con, rapidjson::Document &doc,
+    // dest_pids缺省时返回空, 表示所有会话成员
+    inline bool getDestPids(Type::connection_ptr con, rapidjson::Value &doc,
+                            std::vector<int64_t> *dest_pids);
+    inline bool getRid(Type::connection_ptr con, rapidjson::Value &doc,
                        int64_t *rid, bool sendError = true);
-    inline bool getName(Type::connection_ptr con, rapidjson::Document &doc,
-                        std::string *name, bool sendError = true);
-    inline bool getMsg(Type::connection_ptr con, rapidjson::Document &doc,
-                       std::string *msg, bool sendError = true);
+    inline bool getName(Type::connection_ptr con, rapidjson::Value &doc,
+                        std::string_view *name, bool sendError = true);
+    inline bool getMsg(Type::connection_ptr con, rapidjson::Value &doc,
+                       std::string_view *msg, bool sendError = true);
+    // 可选的非负整数字段, 缺省时count不变
+    inline bool getCount(Type::connection_ptr con, rapidjson::Value &doc,
+                         const char *key, size_t *count);
+    // 可选的翻页游标{"name":..., "pid":...}, 即上一页回复里的next
+    inline bool getCursor(Type::connection_ptr con, rapidjson::Value &doc,
+                          NameIndex::Entry *after, bool *has_after);
+    // 取字符串字段重新序列化后的json文本, 存在storage里
+    inline bool getRaw(Type::connection_ptr con, rapidjson::Value &doc,
+                       const char *key, std::string *storage,
+                       std::string_view *raw, const char *error);
 
     RoomManager *room_manager_;
     PeerManager *peer_manager_;
-    int count_;
+    int min_count_;
+    int max_count_;
+    // 活跃worker为[0, active_), 缩容总是退掉最后一个
+    std::atomic<int> active_;
+    Schedule schedule_;
+    int batch_size_;
     std::atomic_bool start_;
+    // 大小固定为max_count_, 保护线程的启停
     std::vector<std::thread> threads_;
+    std::mutex resize_mu_;
     static log4cxx::LoggerPtr logger_;
-    ProducerConsumerQueue<Context> input_;
+    // SHARED模式只有一个队列, AFFINITY模式每个worker一个
+    std::vector<std::unique_ptr<DispatchQueue<Context>>> inputs_;
+    std::unique_ptr<Slot[]> slots_;
+    std::unique_ptr<WorkerStat[]> stats_;
+    std::atomic<uint64_t> migrations_;
+
+    // 已入队还没处理完的消息数和字节数
+    std::atomic<size_t> depth_;
+    std::atomic<size_t> bytes_;
+    size_t high_depth_;
+    size_t low_depth_;
+    size_t high_bytes_;
+    size_t low_bytes_;
+    std::atomic<bool> shedding_;
+    // 各lane被拒绝的消息数
+    std::unique_ptr<std::atomic<uint64_t>[]> shed_;
+    const RateLimiter *limiter_;
+
+    std::thread monitor_;
+    std::mutex monitor_mu_;
+    std::condition_variable monitor_cv_;
 };
 
 #endif  // _WORKERPOOL_H_
\ No newline at end of file